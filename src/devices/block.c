@@ -139,6 +139,52 @@ block_write (struct block *block, block_sector_t sector, const void *buffer)
   block->write_cnt++;
 }
 
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFERS[0], BUFFERS[1], ..., each of which must have
+   room for BLOCK_SECTOR_SIZE bytes.  If the driver supports it,
+   the sectors are transferred with a single request. */
+void
+block_readv (struct block *block, block_sector_t sector, void *buffers[],
+             size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->readv != NULL)
+    block->ops->readv (block->aux, sector, buffers, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->read (block->aux, sector + i, buffers[i]);
+  block->read_cnt += cnt;
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR in BLOCK
+   from BUFFERS[0], BUFFERS[1], ..., each of which must contain
+   BLOCK_SECTOR_SIZE bytes.  If the driver supports it, the
+   sectors are transferred with a single request.  Returns after
+   the block device has acknowledged receiving the data. */
+void
+block_writev (struct block *block, block_sector_t sector,
+              const void *buffers[], size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  ASSERT (block->type != BLOCK_FOREIGN);
+  if (block->ops->writev != NULL)
+    block->ops->writev (block->aux, sector, buffers, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      block->ops->write (block->aux, sector + i, buffers[i]);
+  block->write_cnt += cnt;
+}
+
 /* Returns the number of sectors in BLOCK. */
 block_sector_t
 block_size (struct block *block)
@@ -53,6 +53,9 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_readv (struct block *, block_sector_t, void *buffers[], size_t cnt);
+void block_writev (struct block *, block_sector_t, const void *buffers[],
+                   size_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -65,6 +68,12 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors as a single
+       request.  If null, READ or WRITE is called per sector. */
+    void (*readv) (void *aux, block_sector_t, void *buffers[], size_t cnt);
+    void (*writev) (void *aux, block_sector_t, const void *buffers[],
+                    size_t cnt);
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -317,8 +317,31 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Reads CNT sectors starting at SECTOR from partition P into
+   BUFFERS, each of which must have room for BLOCK_SECTOR_SIZE
+   bytes. */
+static void
+partition_readv (void *p_, block_sector_t sector, void *buffers[],
+                 size_t cnt)
+{
+  struct partition *p = p_;
+  block_readv (p->block, p->start + sector, buffers, cnt);
+}
+
+/* Writes CNT sectors starting at SECTOR to partition P from
+   BUFFERS, each of which must contain BLOCK_SECTOR_SIZE bytes. */
+static void
+partition_writev (void *p_, block_sector_t sector, const void *buffers[],
+                  size_t cnt)
+{
+  struct partition *p = p_;
+  block_writev (p->block, p->start + sector, buffers, cnt);
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    partition_readv,
+    partition_writev
   };
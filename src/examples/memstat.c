@@ -0,0 +1,50 @@
+/* memstat.c
+
+   Prints the kernel's memory statistics: page pool usage, frame
+   table and swap usage, and malloc() size class counters. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+static void print_pool (const char *name, const struct memstat_pool *);
+
+int
+main (void) 
+{
+  struct memstat stats;
+  size_t i;
+
+  if (!memstat (&stats)) 
+    {
+      printf ("memstat: system call failed\n");
+      return EXIT_FAILURE;
+    }
+
+  print_pool ("kernel", &stats.kernel_pool);
+  print_pool ("user", &stats.user_pool);
+  printf ("frames: %zu of %zu used\n",
+          stats.frame_used_cnt, stats.frame_cnt);
+  printf ("swap: %zu of %zu slots used\n",
+          stats.swap_used_cnt, stats.swap_slot_cnt);
+
+  printf ("%6s %10s %10s %7s %10s\n",
+          "size", "allocs", "frees", "arenas", "wasted");
+  for (i = 0; i < stats.desc_cnt; i++) 
+    {
+      const struct memstat_desc *d = &stats.descs[i];
+      printf ("%6zu %10llu %10llu %7zu %10llu\n", d->block_size,
+              d->alloc_cnt, d->free_cnt, d->arena_cnt, d->wasted_bytes);
+    }
+  printf ("%6s %10llu %10llu %7zu pages\n", "big",
+          stats.big_alloc_cnt, stats.big_free_cnt, stats.big_page_cnt);
+  return EXIT_SUCCESS;
+}
+
+/* Prints the page counts for the pool called NAME. */
+static void
+print_pool (const char *name, const struct memstat_pool *pool) 
+{
+  printf ("%s pool: %zu of %zu pages free, largest free run %zu\n",
+          name, pool->page_cnt - pool->used_cnt, pool->page_cnt,
+          pool->largest_free_run);
+}
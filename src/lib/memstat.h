@@ -0,0 +1,88 @@
+#ifndef __LIB_MEMSTAT_H
+#define __LIB_MEMSTAT_H
+
+#include <stddef.h>
+
+/* Kernel memory statistics.  Filled in by the kernel for the
+   memstat system call and printed at shutdown. */
+
+/* Maximum number of malloc() size classes reported. */
+#define MEMSTAT_DESC_CNT 10
+
+/* One of palloc's page pools. */
+struct memstat_pool
+  {
+    size_t page_cnt;                    /* Pages managed by the pool. */
+    size_t used_cnt;                    /* Pages currently allocated. */
+    size_t largest_free_run;            /* Longest run of free pages. */
+  };
+
+/* One of malloc's size classes ("descriptors"). */
+struct memstat_desc
+  {
+    size_t block_size;                  /* Size of each block in bytes. */
+    unsigned long long alloc_cnt;       /* Blocks handed out. */
+    unsigned long long free_cnt;        /* Blocks given back. */
+    size_t arena_cnt;                   /* Arenas currently allocated. */
+    unsigned long long wasted_bytes;    /* Bytes lost to rounding up. */
+  };
+
+/* Snapshot of the page allocator, malloc(), the frame table,
+   the swap map and paging activity. */
+struct memstat
+  {
+    struct memstat_pool kernel_pool;    /* Kernel page pool. */
+    struct memstat_pool user_pool;      /* User page pool. */
+
+    size_t frame_cnt;                   /* Frame table entries. */
+    size_t frame_used_cnt;              /* Frame table entries in use. */
+    size_t frame_high_cnt;              /* Frames in high memory. */
+    unsigned long long kmap_cnt;        /* High pages mapped by kmap(). */
+    size_t swap_slot_cnt;               /* Page-sized swap slots. */
+    size_t swap_used_cnt;               /* Swap slots in use. */
+    unsigned long long evict_cnt;       /* Pages evicted. */
+    unsigned long long evict_dirty_cnt; /* Evicted pages written out. */
+    unsigned long long evict_over_cnt;  /* ...from sets over allocation. */
+    unsigned long long evict_hard_cnt;  /* ...at owner's hard RSS limit. */
+    size_t rss_cnt;                     /* Caller's resident pages. */
+    unsigned long long tlb_invlpg_cnt;  /* TLB entries invalidated. */
+    unsigned long long tlb_flush_cnt;   /* Whole TLB flushes by batches. */
+    unsigned long long tlb_batched_cnt; /* Invalidations put off to them. */
+    unsigned long long cr3_load_cnt;    /* Page directory loads... */
+    unsigned long long cr3_skip_cnt;    /* ...and loads found unneeded. */
+
+    unsigned long long page_fault_cnt;  /* Page faults taken. */
+    unsigned long long swap_read_cnt;   /* Pages read from swap. */
+    unsigned long long swap_write_cnt;  /* Pages written to swap. */
+    unsigned long long readahead_cnt;   /* Pages read ahead from swap. */
+    unsigned long long readahead_hit_cnt;  /* ...later used. */
+    unsigned long long readahead_miss_cnt; /* ...evicted unused. */
+    unsigned long long clean_cnt;       /* Pages written by the cleaner. */
+    unsigned long long clean_batch_cnt; /* Batches it wrote them in. */
+    size_t pagecache_cnt;               /* Shared file pages cached. */
+    unsigned long long pagecache_hit_cnt; /* Faults served from cache. */
+    unsigned long long cow_copy_cnt;    /* Frames copied on write. */
+    unsigned long long ksm_scan_cnt;    /* Frames scanned for merging. */
+    unsigned long long ksm_merge_cnt;   /* Frames freed by merging. */
+    unsigned long long ksm_unmerge_cnt; /* Merged pages copied on write. */
+    unsigned long long fault_around_cnt; /* Pages mapped by fault-around. */
+    unsigned long long zero_map_cnt;    /* Reads mapped to the zero page. */
+    unsigned long long stack_grow_cnt;  /* Faults that grew the stack... */
+    unsigned long long stack_prefault_cnt; /* ...and pages they added. */
+    size_t zswap_page_cnt;              /* Compressed swap cache pages. */
+    size_t zswap_stored_cnt;            /* Pages in it now... */
+    size_t zswap_stored_bytes;          /* ...and their compressed size. */
+    unsigned long long zswap_store_cnt; /* Pages compressed into it. */
+    unsigned long long zswap_reject_cnt; /* ...or not, compressing poorly. */
+    unsigned long long zswap_hit_cnt;   /* Swap reads served from it. */
+    unsigned long long zswap_miss_cnt;  /* Swap reads that went to disk. */
+    unsigned long long zswap_spill_cnt; /* Pages spilled from it to disk. */
+
+    size_t desc_cnt;                    /* Valid entries in DESCS. */
+    struct memstat_desc descs[MEMSTAT_DESC_CNT];
+    unsigned long long big_alloc_cnt;   /* Multi-page blocks handed out. */
+    unsigned long long big_free_cnt;    /* Multi-page blocks given back. */
+    size_t big_page_cnt;                /* Pages in live multi-page blocks. */
+  };
+
+#endif /* lib/memstat.h */
@@ -28,7 +28,19 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Kernel statistics. */
+    SYS_MEMSTAT,                /* Reports kernel memory statistics. */
+
+    /* Process duplication. */
+    SYS_FORK,                   /* Clone this process. */
+
+    /* Resident set limits. */
+    SYS_SETRSS,                 /* Set resident set size limits. */
+
+    /* Stack size limit. */
+    SYS_STACKLIMIT              /* Set the stack limit for exec. */
   };
 
 #endif /* lib/syscall-nr.h */
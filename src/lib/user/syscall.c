@@ -182,3 +182,27 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+memstat (struct memstat *stats)
+{
+  return syscall1 (SYS_MEMSTAT, stats);
+}
+
+pid_t
+fork (void)
+{
+  return (pid_t) syscall0 (SYS_FORK);
+}
+
+bool
+setrss (size_t soft, size_t hard)
+{
+  return syscall2 (SYS_SETRSS, soft, hard);
+}
+
+bool
+stacklimit (size_t pages)
+{
+  return syscall1 (SYS_STACKLIMIT, pages);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <memstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +46,16 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Kernel statistics. */
+bool memstat (struct memstat *);
+
+/* Process duplication. */
+pid_t fork (void);
+
+/* Resident set limits. */
+bool setrss (size_t soft, size_t hard);
+
+/* Stack size limit. */
+bool stacklimit (size_t pages);
+
 #endif /* lib/user/syscall.h */
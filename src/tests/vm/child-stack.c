@@ -0,0 +1,25 @@
+/* Child process of stack-limit.
+   Uses as many pages of stack as its argument says, and exits
+   with status 0x42 if it was not killed for it. */
+
+#include <stdlib.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-stack";
+
+/* Recurses DEPTH levels with a frame of about 2 kB each. */
+static int
+descend (int depth)
+{
+  volatile char frame[2000];
+
+  frame[0] = depth;
+  return (depth > 0 ? descend (depth - 1) : 0) + frame[0];
+}
+
+int
+main (int argc, char *argv[])
+{
+  descend (atoi (argv[argc - 1]) * 2);
+  return 0x42;
+}
@@ -0,0 +1,49 @@
+/* Reads a read-only array, then runs a second copy of this
+   program that reads it too, and checks that most of the copy's
+   pages of the array were mapped by fault-around, from the page
+   cache, rather than each taking a fault of its own. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "fault-around";
+
+#define SIZE (64 * 1024)
+
+/* Initialized, so that it is read from the executable. */
+static const char data[SIZE] = { 1 };
+
+/* Reads one byte of every page of DATA. */
+static int
+touch_data (void)
+{
+  int sum = 0;
+  size_t i;
+
+  for (i = 0; i < SIZE; i += 4096)
+    sum += data[i];
+  return sum;
+}
+
+int
+main (int argc, char *argv[] UNUSED)
+{
+  struct memstat before, after;
+  pid_t child;
+
+  if (argc > 1)
+    return touch_data () == 1 ? 0x42 : 0;
+
+  msg ("begin");
+  CHECK (touch_data () == 1, "read data");
+  CHECK (memstat (&before), "memstat before");
+  CHECK ((child = exec ("fault-around copy")) != -1,
+         "exec \"fault-around copy\"");
+  CHECK (wait (child) == 0x42, "wait for copy");
+  CHECK (memstat (&after), "memstat after");
+  if (after.fault_around_cnt - before.fault_around_cnt < SIZE / 4096 / 2)
+    fail ("only %llu pages mapped by fault-around",
+          after.fault_around_cnt - before.fault_around_cnt);
+  msg ("end");
+  return 0;
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fault-around) begin
+(fault-around) read data
+(fault-around) memstat before
+(fault-around) exec "fault-around copy"
+(fault-around) wait for copy
+(fault-around) memstat after
+(fault-around) end
+EOF
+pass;
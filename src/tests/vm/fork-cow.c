@@ -0,0 +1,53 @@
+/* Forks a child that overwrites a buffer the parent has already
+   filled, and checks that each process sees only its own
+   writes.  The child's writes must be served by copying the
+   shared frames, which shows up in memstat. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+/* Fails unless every byte of BUF is VALUE. */
+static void
+check_buf (char value)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != value)
+      fail ("byte %zu is %d, not %d", i, buf[i], value);
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  pid_t child;
+
+  memset (buf, 'p', SIZE);
+  CHECK (memstat (&before), "memstat before");
+
+  /* The child stays quiet, so that the output does not depend
+     on which process runs first. */
+  child = fork ();
+  if (child == 0)
+    {
+      check_buf ('p');
+      memset (buf, 'c', SIZE);
+      check_buf ('c');
+      exit (0x42);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf ('p');
+  msg ("parent's buffer intact");
+
+  CHECK (memstat (&after), "memstat after");
+  if (after.cow_copy_cnt == before.cow_copy_cnt)
+    fail ("no frames were copied on write");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-cow) begin
+(fork-cow) memstat before
+(fork-cow) fork
+(fork-cow) wait for child
+(fork-cow) parent's buffer intact
+(fork-cow) memstat after
+(fork-cow) end
+EOF
+pass;
@@ -0,0 +1,90 @@
+/* Measures the page fault and eviction rates of three access
+   patterns over a 2 MB buffer, more than fits in the user pool:
+   a linear sweep like page-linear, random touches like
+   page-shuffle, and a small hot set revisited between cold
+   scans, which a replacement policy that honors accessed bits
+   should keep resident.  Counts come from the memstat system
+   call, so the numbers printed vary with the kernel's eviction
+   policy; only their presence and the buffer's contents are
+   checked. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+#define PAGE_SIZE 4096
+#define PAGE_CNT (SIZE / PAGE_SIZE)
+
+/* Hot set size and cold scan length, in pages. */
+#define HOT_PAGES 32
+#define COLD_PAGES 64
+
+static char buf[SIZE];
+
+/* Fails unless every byte of page PAGE is VALUE. */
+static void
+check_page (size_t page, char value)
+{
+  size_t i;
+
+  for (i = page * PAGE_SIZE; i < (page + 1) * PAGE_SIZE; i++)
+    if (buf[i] != value)
+      fail ("byte %zu is %d, not %d", i, buf[i], value);
+}
+
+/* Prints the paging activity since BEFORE was taken. */
+static void
+report (const char *name, const struct memstat *before)
+{
+  struct memstat after;
+
+  if (!memstat (&after))
+    fail ("memstat failed");
+  msg ("%s: %llu faults, %llu evictions (%llu dirty)", name,
+       after.page_fault_cnt - before->page_fault_cnt,
+       after.evict_cnt - before->evict_cnt,
+       after.evict_dirty_cnt - before->evict_dirty_cnt);
+}
+
+void
+test_main (void)
+{
+  struct memstat before;
+  size_t i, j;
+
+  memset (buf, 0x5a, sizeof buf);
+
+  /* Two linear passes. */
+  memstat (&before);
+  for (i = 0; i < PAGE_CNT; i++)
+    check_page (i, 0x5a);
+  for (i = 0; i < PAGE_CNT; i++)
+    check_page (i, 0x5a);
+  report ("linear", &before);
+
+  /* Random pages, half of them written. */
+  memstat (&before);
+  random_init (0);
+  for (i = 0; i < 2 * PAGE_CNT; i++)
+    {
+      size_t page = random_ulong () % PAGE_CNT;
+      check_page (page, 0x5a);
+      if (i % 2)
+        buf[page * PAGE_SIZE] = 0x5a;
+    }
+  report ("random", &before);
+
+  /* Hot set between cold scans. */
+  memstat (&before);
+  for (i = HOT_PAGES; i + COLD_PAGES <= PAGE_CNT; i += COLD_PAGES)
+    {
+      for (j = 0; j < HOT_PAGES; j++)
+        check_page (j, 0x5a);
+      for (j = i; j < i + COLD_PAGES; j++)
+        check_page (j, 0x5a);
+    }
+  report ("hot/cold", &before);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+foreach my $pattern ('linear', 'random', 'hot/cold') {
+    fail "missing $pattern fault counts in output"
+      unless grep (m{^\(page-fault-rate\) \Q$pattern\E: \d+ faults, \d+ evictions \(\d+ dirty\)$}, @output);
+}
+fail "missing end in output"
+  unless grep ($_ eq '(page-fault-rate) end', @output);
+
+pass;
@@ -0,0 +1,77 @@
+/* Runs with a user pool that lies wholly in high memory, as set
+   up in Make.tests, and checks that pages can be filled, evicted
+   to swap, read back and copied on write there.  The kernel must
+   have reached the frames through temporary mappings, which
+   shows up in memstat. */
+
+#include <memstat.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Twice the user pool given to the kernel by -ul. */
+#define SIZE (2 * 1024 * 1024)
+
+/* Bytes the child overwrites. */
+#define CHILD_SIZE (64 * 1024)
+
+static char buf[SIZE];
+
+/* Returns the byte expected at BUF[I]. */
+static char
+expected (size_t i)
+{
+  return i / 4096 * 7 + i % 3;
+}
+
+/* Fails unless BUF holds the expected bytes from OFS on. */
+static void
+check_buf (size_t ofs)
+{
+  size_t i;
+
+  for (i = ofs; i < SIZE; i++)
+    if (buf[i] != expected (i))
+      fail ("byte %zu is %d, not %d", i, buf[i], expected (i));
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  pid_t child;
+  size_t i;
+
+  CHECK (memstat (&before), "memstat before");
+  if (before.frame_high_cnt != before.frame_cnt)
+    fail ("%zu of %zu frames in high memory", before.frame_high_cnt,
+          before.frame_cnt);
+
+  msg ("fill");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = expected (i);
+  msg ("check");
+  check_buf (0);
+
+  /* The child stays quiet, so that the output does not depend
+     on which process runs first. */
+  child = fork ();
+  if (child == 0)
+    {
+      memset (buf, 'c', CHILD_SIZE);
+      for (i = 0; i < CHILD_SIZE; i++)
+        if (buf[i] != 'c')
+          exit (1);
+      check_buf (CHILD_SIZE);
+      exit (0x42);
+    }
+  CHECK (child != -1, "fork");
+  CHECK (wait (child) == 0x42, "wait for child");
+  check_buf (0);
+  msg ("parent's buffer intact");
+
+  CHECK (memstat (&after), "memstat after");
+  if (after.kmap_cnt == before.kmap_cnt)
+    fail ("no high memory frames were mapped by the kernel");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-highmem) begin
+(page-highmem) memstat before
+(page-highmem) fill
+(page-highmem) check
+(page-highmem) fork
+(page-highmem) wait for child
+(page-highmem) parent's buffer intact
+(page-highmem) memstat after
+(page-highmem) end
+EOF
+pass;
@@ -0,0 +1,32 @@
+/* Runs a second copy of this program while the first is still
+   running, and checks that the copy's text page faults were
+   served from the page cache, that is, by mapping the frames
+   that already hold the first copy's text rather than reading
+   the executable again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "page-share";
+
+int
+main (int argc, char *argv[] UNUSED)
+{
+  struct memstat before, after;
+  pid_t child;
+
+  /* The copy only has to run: its faults are what is
+     measured. */
+  if (argc > 1)
+    return 0x42;
+
+  msg ("begin");
+  CHECK (memstat (&before), "memstat before");
+  CHECK ((child = exec ("page-share copy")) != -1, "exec \"page-share copy\"");
+  CHECK (wait (child) == 0x42, "wait for copy");
+  CHECK (memstat (&after), "memstat after");
+  if (after.pagecache_hit_cnt == before.pagecache_hit_cnt)
+    fail ("copy's text pages were not shared");
+  msg ("end");
+  return 0;
+}
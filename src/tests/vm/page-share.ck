@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-share) begin
+(page-share) memstat before
+(page-share) exec "page-share copy"
+(page-share) wait for copy
+(page-share) memstat after
+(page-share) end
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Sets a hard resident set limit of HARD pages, writes and then
+   checks 1 MB of memory, and checks that the process never held
+   many more pages than the limit allows, and that it got them by
+   evicting its own pages. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define HARD 32
+
+/* Pages a process may overshoot its limit by, when swap
+   read-ahead brings in several pages at once. */
+#define SLACK 16
+
+static char buf[SIZE];
+
+/* Returns the byte expected at BUF[I]. */
+static char
+expected (size_t i)
+{
+  return i / 4096 * 3 + i % 5;
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  size_t i;
+
+  CHECK (!setrss (HARD + 1, HARD), "setrss with soft above hard fails");
+  CHECK (setrss (0, HARD), "setrss");
+  CHECK (memstat (&before), "memstat before");
+  msg ("fill");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = expected (i);
+  msg ("check");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != expected (i))
+      fail ("byte %zu is %d, not %d", i, buf[i], expected (i));
+  CHECK (memstat (&after), "memstat after");
+
+  if (after.rss_cnt > HARD + SLACK)
+    fail ("%zu pages resident, limit is %d", after.rss_cnt, HARD);
+  if (after.evict_hard_cnt == before.evict_hard_cnt)
+    fail ("no pages evicted at the hard limit");
+}
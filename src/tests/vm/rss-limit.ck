@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) setrss with soft above hard fails
+(rss-limit) setrss
+(rss-limit) memstat before
+(rss-limit) fill
+(rss-limit) check
+(rss-limit) memstat after
+(rss-limit) end
+EOF
+pass;
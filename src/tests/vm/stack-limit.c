@@ -0,0 +1,27 @@
+/* Lowers the stack limit for the processes it runs, then runs
+   one child that stays within the limit and one that does not.
+   The second one must be killed when its stack reaches the
+   guard page below the limit. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Stack limit for the children, in pages. */
+#define LIMIT 16
+
+void
+test_main (void)
+{
+  pid_t child;
+
+  CHECK (!stacklimit (0), "stacklimit of 0 pages fails");
+  CHECK (stacklimit (LIMIT), "stacklimit");
+
+  CHECK ((child = exec ("child-stack 8")) != -1, "exec \"child-stack 8\"");
+  CHECK (wait (child) == 0x42, "wait for child within limit");
+
+  CHECK ((child = exec ("child-stack 64")) != -1,
+         "exec \"child-stack 64\"");
+  CHECK (wait (child) == -1, "wait for child over limit");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(stack-limit) begin
+(stack-limit) stacklimit of 0 pages fails
+(stack-limit) stacklimit
+(stack-limit) exec "child-stack 8"
+(stack-limit) wait for child within limit
+(stack-limit) exec "child-stack 64"
+(stack-limit) wait for child over limit
+(stack-limit) end
+EOF
+pass;
@@ -0,0 +1,50 @@
+/* Grows the stack by 1 MB through deep recursion, a page at a
+   time, and checks that the kernel pre-faulted stack pages ahead
+   of it rather than taking a fault for each one. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Stack pages the recursion touches, with two frames a page. */
+#define PAGE_CNT 256
+#define DEPTH (PAGE_CNT * 2)
+
+/* Recurses DEPTH levels with a frame of about 2 kB each, writing
+   each frame, and returns the sum of the depths. */
+static int
+descend (int depth)
+{
+  volatile char frame[2000];
+  int sum;
+
+  frame[0] = frame[sizeof frame - 1] = depth;
+  sum = depth > 0 ? descend (depth - 1) : 0;
+  return (sum + (unsigned char) frame[0]
+          + (frame[sizeof frame - 1] != frame[0]));
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  long long faults;
+  int sum, i;
+
+  CHECK (memstat (&before), "memstat before");
+  sum = descend (DEPTH);
+  CHECK (memstat (&after), "memstat after");
+
+  for (i = 0; i <= DEPTH; i++)
+    sum -= i % 256;
+  if (sum != 0)
+    fail ("stack frames were corrupted");
+
+  faults = after.page_fault_cnt - before.page_fault_cnt;
+  if (faults >= PAGE_CNT / 4)
+    fail ("%lld page faults for %d stack pages", faults, PAGE_CNT);
+  if (after.stack_prefault_cnt == before.stack_prefault_cnt)
+    fail ("no stack pages were pre-faulted");
+  msg ("stack grew with few faults");
+}
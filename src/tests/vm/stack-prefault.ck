@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(stack-prefault) begin
+(stack-prefault) memstat before
+(stack-prefault) memstat after
+(stack-prefault) stack grew with few faults
+(stack-prefault) end
+EOF
+pass;
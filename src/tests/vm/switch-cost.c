@@ -0,0 +1,116 @@
+/* Measures what a context switch costs a process.  The parent
+   forks a child, and both run the same loop: each iteration
+   makes a system call and reads a word from each of PAGE_CNT
+   pages, timed with the time-stamp counter.  The timer preempts
+   each process in favor of the other now and then, so that an
+   iteration now and then spans a whole time slice of the other
+   process.  The iteration after it runs on a TLB that the
+   switches have left as they left it, and costs more than the
+   others by about what the process pays for refilling it.
+
+   The numbers vary with the machine and the kernel, so only
+   their presence is checked.  CR3 loads and loads skipped, from
+   memstat, show how many switches had to flush the TLB. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 32
+#define ITERATIONS 50000
+
+/* An iteration longer than this many cycles was interrupted by
+   a switch to the other process. */
+#define SWITCH_CYCLES 200000
+
+static char pages[PAGE_CNT * PAGE_SIZE];
+
+/* Returns the time-stamp counter. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Runs the loop, and stores in *SWITCHES the number of times it
+   was switched out, in *AFTER the total cycles of the
+   iterations right after those, and in *STEADY the average
+   cycles of the other iterations. */
+static void
+run (int fd, int *switches, uint64_t *after, uint64_t *steady)
+{
+  uint64_t steady_total = 0;
+  int steady_cnt = 0;
+  bool switched = false;
+  int i, j;
+
+  *switches = 0;
+  *after = 0;
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      uint64_t start = rdtsc (), cycles;
+      volatile char *p;
+
+      tell (fd);
+      for (j = 0; j < PAGE_CNT; j++)
+        {
+          p = pages + j * PAGE_SIZE;
+          (void) *p;
+        }
+      cycles = rdtsc () - start;
+
+      if (cycles > SWITCH_CYCLES)
+        {
+          ++*switches;
+          switched = true;
+        }
+      else if (switched)
+        {
+          *after += cycles;
+          switched = false;
+        }
+      else
+        {
+          steady_total += cycles;
+          steady_cnt++;
+        }
+    }
+  *steady = steady_cnt > 0 ? steady_total / steady_cnt : 0;
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  uint64_t after_cycles, steady;
+  int switches;
+  pid_t child;
+  int fd;
+
+  CHECK ((fd = open ("switch-cost")) > 1, "open \"switch-cost\"");
+  CHECK (memstat (&before), "memstat before");
+
+  /* The child stays quiet, so that the output does not depend
+     on which process runs first. */
+  child = fork ();
+  if (child == 0)
+    {
+      run (fd, &switches, &after_cycles, &steady);
+      exit (0);
+    }
+  CHECK (child != -1, "fork");
+  run (fd, &switches, &after_cycles, &steady);
+  CHECK (wait (child) == 0, "wait for child");
+  CHECK (memstat (&after), "memstat after");
+
+  msg ("switched out %d times: %llu cycles per iteration after a switch, "
+       "%llu otherwise", switches,
+       switches > 0 ? after_cycles / switches : 0, steady);
+  msg ("%llu CR3 loads, %llu skipped",
+       after.cr3_load_cnt - before.cr3_load_cnt,
+       after.cr3_skip_cnt - before.cr3_skip_cnt);
+}
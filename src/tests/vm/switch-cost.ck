@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+@output = get_core_output ("run", @output);
+fail "missing switch cost in output"
+  unless grep (m{^\(switch-cost\) switched out \d+ times: \d+ cycles per iteration after a switch, \d+ otherwise$}, @output);
+fail "missing CR3 loads in output"
+  unless grep (m{^\(switch-cost\) \d+ CR3 loads, \d+ skipped$}, @output);
+fail "missing end in output"
+  unless grep ($_ eq '(switch-cost) end', @output);
+
+pass;
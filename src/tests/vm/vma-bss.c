@@ -0,0 +1,38 @@
+/* Touches a few scattered pages of a 16 MB BSS, bigger than
+   user memory, and checks that they read as zeros, keep what is
+   written to them, and are the only ones given frames. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 1024 * 1024)
+#define STRIDE (1024 * 1024)
+
+static char big[SIZE];
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  size_t touched = SIZE / STRIDE;
+  size_t i;
+
+  CHECK (memstat (&before), "memstat before");
+  for (i = 0; i < SIZE; i += STRIDE)
+    {
+      if (big[i] != 0)
+        fail ("byte %zu is %d, not 0", i, big[i]);
+      big[i] = i / STRIDE + 1;
+    }
+  for (i = 0; i < SIZE; i += STRIDE)
+    if (big[i] != (char) (i / STRIDE + 1))
+      fail ("byte %zu is %d, not %d", i, big[i], (int) (i / STRIDE + 1));
+  msg ("touched pages intact");
+
+  CHECK (memstat (&after), "memstat after");
+  if (after.frame_used_cnt > before.frame_used_cnt + touched + 8)
+    fail ("%zu frames used for %zu touched pages",
+          after.frame_used_cnt - before.frame_used_cnt, touched);
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vma-bss) begin
+(vma-bss) memstat before
+(vma-bss) touched pages intact
+(vma-bss) memstat after
+(vma-bss) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Reads every page of a 1 MB BSS array, which should map them
+   all to the shared zero page rather than give each a frame,
+   then writes one page and checks that the others still read
+   as zeros. */
+
+#include <memstat.h>
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define PAGE_CNT (SIZE / 4096)
+
+/* Page-aligned, so that no page of it shares a page with the
+   data segment's file bytes. */
+static char bss[SIZE] __attribute__ ((aligned (4096)));
+
+/* Fails unless every page of BSS but page SKIP starts with a
+   zero byte. */
+static void
+check_zeros (size_t skip)
+{
+  size_t i;
+
+  for (i = 0; i < PAGE_CNT; i++)
+    if (i != skip && bss[i * 4096] != 0)
+      fail ("page %zu is not zero", i);
+}
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+
+  if ((uintptr_t) bss % 4096 != 0)
+    fail ("bss at %p is not page-aligned", bss);
+
+  CHECK (memstat (&before), "memstat before");
+  check_zeros (PAGE_CNT);
+  CHECK (memstat (&after), "memstat after reading");
+  if (after.zero_map_cnt - before.zero_map_cnt < PAGE_CNT)
+    fail ("only %llu of %d pages mapped to the zero page",
+          after.zero_map_cnt - before.zero_map_cnt, PAGE_CNT);
+  if (after.frame_used_cnt > before.frame_used_cnt + PAGE_CNT / 8)
+    fail ("reading zeros used %zu frames",
+          after.frame_used_cnt - before.frame_used_cnt);
+
+  bss[7 * 4096] = 'x';
+  check_zeros (7);
+  CHECK (bss[0] == 0, "first page still reads as zeros");
+  CHECK (bss[7 * 4096] == 'x', "written page kept its write");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zero-page) begin
+(zero-page) memstat before
+(zero-page) memstat after reading
+(zero-page) first page still reads as zeros
+(zero-page) written page kept its write
+(zero-page) end
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Fills 2 MB of memory with a compressible pattern, twice the
+   user pool given to the kernel by -ul in Make.tests, then checks
+   it, and checks that the swap writes this forces went to the
+   compressed swap cache and that swap reads were served from
+   it. */
+
+#include <memstat.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (2 * 1024 * 1024)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  struct memstat before, after;
+  size_t i;
+
+  CHECK (memstat (&before), "memstat before");
+  msg ("fill");
+  for (i = 0; i < SIZE; i++)
+    buf[i] = i / 512 % 7;
+  msg ("check");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != (char) (i / 512 % 7))
+      fail ("byte %zu is %d, not %d", i, buf[i], (int) (i / 512 % 7));
+  CHECK (memstat (&after), "memstat after");
+
+  if (after.zswap_page_cnt == 0)
+    fail ("the compressed swap cache is off");
+  if (after.swap_write_cnt == before.swap_write_cnt)
+    fail ("nothing was written to swap");
+  if (after.zswap_store_cnt == before.zswap_store_cnt)
+    fail ("no pages went to the compressed swap cache");
+  if (after.swap_read_cnt == before.swap_read_cnt)
+    fail ("nothing was read from swap");
+  if (after.zswap_hit_cnt == before.zswap_hit_cnt)
+    fail ("no swap reads were served from the cache");
+}
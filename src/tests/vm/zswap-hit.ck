@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(zswap-hit) begin
+(zswap-hit) memstat before
+(zswap-hit) fill
+(zswap-hit) check
+(zswap-hit) memstat after
+(zswap-hit) end
+EOF
+pass;
@@ -0,0 +1,265 @@
+#include "threads/allocprof.h"
+#ifdef ALLOCPROF
+#include <debug.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Allocation callsite profiler.
+
+   Two tables are kept.  The callsite table aggregates, for each
+   distinct (kind, caller) pair, the number of live blocks and
+   bytes and the total number of allocations.  The allocation
+   table maps each live block's address to its size and its
+   callsite, so that a free can be charged back to the callsite
+   that made the allocation.
+
+   Both are open-addressed hash tables with linear probing.  The
+   callsite table is small and static.  The allocation table is
+   taken from the kernel pool by allocprof_init(); allocations
+   made before that, or while the table is full, are not tracked
+   and frees of such blocks are ignored.
+
+   The tables are updated with interrupts disabled, because
+   malloc() and palloc_get_page() are called while holding all
+   sorts of locks, and even before locks can be used. */
+
+/* Number of distinct callsites that can be tracked. */
+#define SITE_CNT 256
+
+/* Pages of kernel pool given to the allocation table. */
+#define ALLOC_TABLE_PAGES 32
+
+/* A callsite. */
+struct site
+  {
+    void *caller;                       /* Return address, or null. */
+    enum allocprof_kind kind;           /* What kind of allocator. */
+    size_t live_cnt;                    /* Blocks currently allocated. */
+    size_t live_bytes;                  /* Bytes currently allocated. */
+    unsigned long long alloc_cnt;       /* Total allocations. */
+  };
+
+/* A live allocation. */
+struct alloc
+  {
+    void *block;                        /* Block address, or null. */
+    uint32_t size;                      /* Size in bytes. */
+    uint16_t site;                      /* Index into sites[]. */
+  };
+
+static struct site sites[SITE_CNT];
+static size_t site_used_cnt;            /* Sites in use. */
+
+static struct alloc *allocs;            /* Allocation table. */
+static size_t alloc_slot_cnt;           /* Slots in allocation table. */
+static size_t alloc_used_cnt;           /* Slots in use. */
+
+static unsigned long long lost_cnt;     /* Allocations not tracked. */
+
+static unsigned hash_ptr (const void *);
+static struct site *find_site (enum allocprof_kind, void *caller);
+static struct alloc *find_alloc (const void *block);
+static void remove_alloc (struct alloc *);
+
+/* Allocates the allocation table.  Must be called after
+   palloc_init(). */
+void
+allocprof_init (void)
+{
+  struct alloc *table = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                                             ALLOC_TABLE_PAGES);
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  allocs = table;
+  alloc_slot_cnt = ALLOC_TABLE_PAGES * PGSIZE / sizeof *allocs;
+  alloc_used_cnt = 0;
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK, SIZE bytes long, was allocated by the
+   allocator of the given KIND on behalf of CALLER. */
+void
+allocprof_alloc (enum allocprof_kind kind, void *block, size_t size,
+                 void *caller)
+{
+  enum intr_level old_level;
+  struct site *s;
+
+  if (block == NULL)
+    return;
+
+  old_level = intr_disable ();
+  s = find_site (kind, caller);
+  if (s != NULL && allocs != NULL && alloc_used_cnt < alloc_slot_cnt * 3 / 4)
+    {
+      struct alloc *a = find_alloc (block);
+      ASSERT (a->block == NULL);
+      a->block = block;
+      a->size = size;
+      a->site = s - sites;
+      alloc_used_cnt++;
+
+      s->live_cnt++;
+      s->live_bytes += size;
+      s->alloc_cnt++;
+    }
+  else
+    lost_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Records that BLOCK has been freed. */
+void
+allocprof_free (void *block)
+{
+  enum intr_level old_level;
+  struct alloc *a;
+
+  if (block == NULL || allocs == NULL)
+    return;
+
+  old_level = intr_disable ();
+  a = find_alloc (block);
+  if (a->block != NULL)
+    {
+      struct site *s = &sites[a->site];
+      s->live_cnt--;
+      s->live_bytes -= a->size;
+      remove_alloc (a);
+    }
+  intr_set_level (old_level);
+}
+
+/* Prints the CNT callsites holding the most live bytes,
+   followed by a line of their addresses that can be passed to
+   the "backtrace" utility to translate them into function names
+   and line numbers. */
+void
+allocprof_dump (size_t cnt)
+{
+  static bool printed[SITE_CNT];
+  static void *callers[SITE_CNT];
+  int64_t ticks = timer_ticks ();
+  size_t caller_cnt = 0;
+  size_t i, j;
+
+  printf ("Allocation profile: %zu callsites, %zu live blocks tracked, "
+          "%llu allocations not tracked\n",
+          site_used_cnt, alloc_used_cnt, lost_cnt);
+
+  for (i = 0; i < SITE_CNT; i++)
+    printed[i] = false;
+  for (i = 0; i < cnt; i++)
+    {
+      struct site *best = NULL;
+      unsigned long long rate;
+
+      for (j = 0; j < SITE_CNT; j++)
+        if (sites[j].caller != NULL && !printed[j]
+            && (best == NULL || sites[j].live_bytes > best->live_bytes))
+          best = &sites[j];
+      if (best == NULL)
+        break;
+      printed[best - sites] = true;
+
+      rate = ticks > 0 ? best->alloc_cnt * TIMER_FREQ / ticks : 0;
+      printf ("  %#010"PRIxPTR" %s: %zu bytes live in %zu blocks, "
+              "%llu allocs (%llu/s)\n",
+              (uintptr_t) best->caller,
+              best->kind == ALLOCPROF_MALLOC ? "malloc" : "palloc",
+              best->live_bytes, best->live_cnt, best->alloc_cnt, rate);
+      callers[caller_cnt++] = best->caller;
+    }
+
+  printf ("Callsites:");
+  for (i = 0; i < caller_cnt; i++)
+    printf (" %p", callers[i]);
+  printf (".\n");
+}
+
+/* Returns a hash value for pointer P. */
+static unsigned
+hash_ptr (const void *p)
+{
+  return ((uintptr_t) p >> 4) * 2654435761u;
+}
+
+/* Returns the callsite for KIND and CALLER, creating it if
+   necessary, or a null pointer if the callsite table is full. */
+static struct site *
+find_site (enum allocprof_kind kind, void *caller)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = hash_ptr (caller) % SITE_CNT; ; i = (i + 1) % SITE_CNT)
+    {
+      struct site *s = &sites[i];
+      if (s->caller == caller && s->kind == kind)
+        return s;
+      else if (s->caller == NULL)
+        {
+          if (site_used_cnt >= SITE_CNT - 1)
+            return NULL;
+          site_used_cnt++;
+          s->caller = caller;
+          s->kind = kind;
+          return s;
+        }
+    }
+}
+
+/* Returns the allocation table slot for BLOCK: the slot holding
+   it, if it is in the table, otherwise the empty slot where it
+   belongs. */
+static struct alloc *
+find_alloc (const void *block)
+{
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = hash_ptr (block) % alloc_slot_cnt; ;
+       i = (i + 1) % alloc_slot_cnt)
+    if (allocs[i].block == block || allocs[i].block == NULL)
+      return &allocs[i];
+}
+
+/* Removes A from the allocation table, moving later entries of
+   its probe sequence back so that lookups never stop early at
+   the hole. */
+static void
+remove_alloc (struct alloc *a)
+{
+  size_t hole = a - allocs;
+  size_t i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  allocs[hole].block = NULL;
+  alloc_used_cnt--;
+  for (i = (hole + 1) % alloc_slot_cnt; allocs[i].block != NULL;
+       i = (i + 1) % alloc_slot_cnt)
+    {
+      size_t home = hash_ptr (allocs[i].block) % alloc_slot_cnt;
+
+      /* Move entry I into the hole unless its home slot lies
+         cyclically in (HOLE, I]. */
+      if ((i > hole && (home <= hole || home > i))
+          || (i < hole && home <= hole && home > i))
+        {
+          allocs[hole] = allocs[i];
+          allocs[i].block = NULL;
+          hole = i;
+        }
+    }
+}
+#endif /* ALLOCPROF */
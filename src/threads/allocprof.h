@@ -0,0 +1,46 @@
+#ifndef THREADS_ALLOCPROF_H
+#define THREADS_ALLOCPROF_H
+
+#include <debug.h>
+#include <stddef.h>
+
+/* Allocation callsite profiler.
+
+   When the kernel is built with ALLOCPROF defined (run "make
+   ALLOCPROF=1"), every malloc(), calloc(), realloc() and
+   kernel-pool palloc_get_*() allocation is tagged with the
+   address of its caller, and live bytes and allocation counts
+   are aggregated per callsite.  Otherwise these functions
+   compile to nothing.
+
+   malloc() gets its arenas from palloc_get_page(), so the pages
+   behind small blocks show up a second time, as palloc
+   callsites inside malloc.c. */
+
+/* Kinds of allocation. */
+enum allocprof_kind
+  {
+    ALLOCPROF_MALLOC,           /* malloc(), calloc(), realloc(). */
+    ALLOCPROF_PALLOC            /* palloc_get_page/multiple(). */
+  };
+
+/* Number of callsites printed by default. */
+#define ALLOCPROF_TOP 10
+
+#ifdef ALLOCPROF
+void allocprof_init (void);
+void allocprof_alloc (enum allocprof_kind, void *, size_t, void *caller);
+void allocprof_free (void *);
+void allocprof_dump (size_t cnt);
+#else
+static inline void allocprof_init (void) {}
+static inline void
+allocprof_alloc (enum allocprof_kind kind UNUSED, void *p UNUSED,
+                 size_t size UNUSED, void *caller UNUSED)
+{
+}
+static inline void allocprof_free (void *p UNUSED) {}
+static inline void allocprof_dump (size_t cnt UNUSED) {}
+#endif
+
+#endif /* threads/allocprof.h */
@@ -15,8 +15,10 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/allocprof.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/kmap.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
@@ -28,6 +30,12 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "vm/cleaner.h"
+#include "vm/evict.h"
+#include "vm/ksm.h"
+#include "vm/pagecache.h"
+#include "vm/swap.h"
+#include "vm/zswap.h"
 #else
 #include "tests/threads/tests.h"
 #endif
@@ -57,8 +65,25 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef USERPROG
+/* -zswap: Kernel pages for the compressed swap cache. */
+static size_t zswap_page_cnt = ZSWAP_DEFAULT_PAGES;
+
+/* -ksm: Frames scanned per second for same-page merging. */
+static unsigned ksm_scan_rate;
+#endif
+
+/* CR4 bits that enable 4 MB pages and global pages. */
+#define CR4_PSE 0x10
+#define CR4_PGE 0x80
+
+/* CPUID leaf 1 EDX bits for 4 MB page and global page support. */
+#define CPUID_PSE (1u << 3)
+#define CPUID_PGE (1u << 13)
+
 static void bss_init (void);
 static void paging_init (void);
+static uint32_t cpuid_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -92,10 +117,11 @@ main (void)
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
-          init_ram_pages * PGSIZE / 1024);
+          init_ram_pages * (PGSIZE / 1024));
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  allocprof_init ();
   malloc_init ();
   paging_init ();
   
@@ -126,6 +152,13 @@ main (void)
   ide_init ();
   locate_block_devices ();
   filesys_init (format_filesys);
+#ifdef USERPROG
+  swap_init ();
+  zswap_init (zswap_page_cnt);
+  pagecache_init ();
+  cleaner_init ();
+  ksm_init (ksm_scan_rate);
+#endif
 #endif
 
   printf ("Boot complete.\n");
@@ -152,19 +185,26 @@ bss_init (void)
 }
 
 /* Populates the base page directory and page table with the
-   kernel virtual mapping, and then sets up the CPU to use the
-   new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   kernel virtual mapping of low memory and the window for
+   high memory, and then sets up the CPU to use the new page
+   directory.  Points init_page_dir to the page directory it
+   creates. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
-  size_t page;
+  size_t page, page_cnt;
+  size_t low_pages = init_ram_pages < LOWMEM_LIMIT / PGSIZE
+                     ? init_ram_pages : LOWMEM_LIMIT / PGSIZE;
   extern char _start, _end_kernel_text;
+  uint32_t features = cpuid_features ();
+  bool pse = (features & CPUID_PSE) != 0;
+  bool pge = (features & CPUID_PGE) != 0;
+  uint32_t cr4;
 
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
-  for (page = 0; page < init_ram_pages; page++)
+  for (page = 0; page < low_pages; page += page_cnt)
     {
       uintptr_t paddr = page * PGSIZE;
       char *vaddr = ptov (paddr);
@@ -172,6 +212,21 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      /* Map each whole 4 MB of RAM with a single 4 MB page, if
+         the CPU can, which spares a page table and takes one TLB
+         entry instead of 1,024.  The 4 MB that hold the kernel
+         image keep 4 kB pages, so that the kernel's code can be
+         mapped read-only, and so does RAM beyond the last whole
+         4 MB. */
+      page_cnt = PTSPAN / PGSIZE;
+      if (pse && pte_idx == 0 && low_pages - page >= page_cnt
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr) | (pge ? PTE_G : 0);
+          continue;
+        }
+      page_cnt = 1;
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -179,7 +234,26 @@ paging_init (void)
         }
 
       pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      if (pge)
+        pt[pte_idx] |= PTE_G;
     }
+  kmap_init (pd);
+
+  /* Every page directory maps the kernel the same way, so the
+     kernel's TLB entries are valid whichever is active.  Marking
+     them global and enabling global pages keeps them in the TLB
+     across the CR3 loads of context switches.  See [IA32-v3a]
+     3.12 "Translation Lookaside Buffers (TLBs)".
+
+     4 MB pages must be enabled before the page directory that
+     uses them is loaded, or the CPU would take them for page
+     tables. */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (pse)
+    cr4 |= CR4_PSE;
+  if (pge)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
 
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
@@ -189,6 +263,16 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns the feature flags that CPUID leaf 1 reports in EDX. */
+static uint32_t
+cpuid_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -260,6 +344,20 @@ parse_options (char **argv)
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-evict"))
+        {
+          if (value == NULL || !evict_set_policy (value))
+            PANIC ("unknown eviction policy `%s'", value ? value : "");
+        }
+      else if (!strcmp (name, "-ksm"))
+        ksm_scan_rate = atoi (value);
+      else if (!strcmp (name, "-zswap"))
+        zswap_page_cnt = atoi (value);
+      else if (!strcmp (name, "-fa"))
+        {
+          if (value == NULL || !palloc_set_fault_around (atoi (value)))
+            PANIC ("bad fault-around window `%s'", value ? value : "");
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -293,6 +391,15 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+#ifdef ALLOCPROF
+/* Prints the callsites holding the most kernel memory. */
+static void
+allocprof_action (char **argv UNUSED)
+{
+  allocprof_dump (ALLOCPROF_TOP);
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
    up to the null pointer sentinel. */
 static void
@@ -316,6 +423,9 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+#endif
+#ifdef ALLOCPROF
+      {"allocprof", 1, allocprof_action},
 #endif
       {NULL, 0, NULL},
     };
@@ -365,6 +475,9 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+#endif
+#ifdef ALLOCPROF
+          "  allocprof          Print the top allocation callsites.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -382,6 +495,10 @@ usage (void)
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -evict=POLICY      Evict pages by POLICY (clock, wsclock).\n"
+          "  -ksm=RATE          Merge identical pages, scanning RATE/s.\n"
+          "  -zswap=PAGES       Use PAGES pages for compressed swap (0=off).\n"
+          "  -fa=PAGES          Map up to PAGES cached pages per fault.\n"
 #endif
           );
   shutdown_power_off ();
@@ -0,0 +1,168 @@
+#include "threads/kmap.h"
+#include <debug.h>
+#include <memstat.h>
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Temporary kernel mappings of high memory.
+
+   The kernel maps physical memory at PHYS_BASE only up to
+   LOWMEM_LIMIT.  Memory above that goes to the user pool, and
+   the kernel never needs a lasting address for it: it touches a
+   user frame only to fill, copy, compare or write it out.
+   kmap() gives a page of high memory a kernel address for that
+   long, in a window of KMAP_PAGES pages whose page table every
+   page directory shares, and kunmap() takes the address away
+   again.  A page of low memory is returned at its address in the
+   direct map, and kunmap() leaves it alone, so callers need not
+   care which kind of page they have.
+
+   A slot in the window is free if its PTE is zero.
+
+   kmap() sleeps while the window is full, so two rules keep the
+   window from deadlocking the VM:
+
+   - A thread holding a slot must not wait for frame_lock, since
+     a thread holding frame_lock may be waiting for a slot.
+
+   - A thread must not wait for a slot while it holds one, since
+     threads doing so could hold all the slots between them.  A
+     thread that needs several pages at once maps them with one
+     call to kmap_multiple(). */
+
+/* Page table that maps the window. */
+static uint32_t *kmap_pt;
+
+/* Protects kmap_pt and kmap_hand. */
+static struct lock kmap_lock;
+
+/* Counts the free slots.  kmap() waits on it if there are none. */
+static struct semaphore kmap_free;
+
+/* Held by kmap_multiple() while it takes its slots, so that at
+   most one thread at a time has some of the slots it needs but
+   not all. */
+static struct lock kmap_multiple_lock;
+
+/* Slot at which the search for a free slot starts. */
+static size_t kmap_hand;
+
+/* Pages of high memory mapped, protected by kmap_lock. */
+static unsigned long long kmap_cnt;
+
+static void *map_slot (uintptr_t paddr);
+
+/* Creates the page table for the window and installs it in page
+   directory PD, from which every other page directory copies
+   its kernel mappings. */
+void
+kmap_init (uint32_t *pd)
+{
+  kmap_pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  pd[pd_no (KMAP_BASE)] = pde_create (kmap_pt);
+  lock_init (&kmap_lock);
+  lock_init (&kmap_multiple_lock);
+  sema_init (&kmap_free, KMAP_PAGES);
+}
+
+/* Returns a kernel virtual address for the page at physical
+   address PADDR.  The caller must give it up with kunmap() when
+   it is done with the page, and should not hold it long, since
+   there are few slots for pages of high memory.  Sleeps until a
+   slot is free if none is. */
+void *
+kmap (uintptr_t paddr)
+{
+  ASSERT ((paddr & PGMASK) == 0);
+  ASSERT (paddr >> PGBITS < init_ram_pages);
+
+  if (paddr < LOWMEM_LIMIT)
+    return ptov (paddr);
+
+  sema_down (&kmap_free);
+  return map_slot (paddr);
+}
+
+/* Maps the CNT pages at the physical addresses in PADDRS, like
+   kmap(), and stores their kernel virtual addresses in KPAGES.
+   Takes the slots for all of them before mapping any, so it
+   sleeps, if it must, holding none.  CNT must be much smaller
+   than KMAP_PAGES. */
+void
+kmap_multiple (const uintptr_t paddrs[], void *kpages[], size_t cnt)
+{
+  size_t high_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= KMAP_PAGES / 16);
+
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT ((paddrs[i] & PGMASK) == 0);
+      ASSERT (paddrs[i] >> PGBITS < init_ram_pages);
+      if (paddrs[i] >= LOWMEM_LIMIT)
+        high_cnt++;
+    }
+
+  if (high_cnt > 0)
+    {
+      lock_acquire (&kmap_multiple_lock);
+      for (i = 0; i < high_cnt; i++)
+        sema_down (&kmap_free);
+      lock_release (&kmap_multiple_lock);
+    }
+
+  for (i = 0; i < cnt; i++)
+    kpages[i] = (paddrs[i] < LOWMEM_LIMIT
+                 ? ptov (paddrs[i]) : map_slot (paddrs[i]));
+}
+
+/* Maps the page at physical address PADDR into a free slot, one
+   of which the caller has taken from kmap_free, and returns the
+   slot's address. */
+static void *
+map_slot (uintptr_t paddr)
+{
+  size_t slot;
+
+  lock_acquire (&kmap_lock);
+  while (kmap_pt[kmap_hand] != 0)
+    kmap_hand = (kmap_hand + 1) % KMAP_PAGES;
+  slot = kmap_hand;
+  kmap_pt[slot] = pte_create_phys (paddr, true);
+  kmap_cnt++;
+  lock_release (&kmap_lock);
+
+  return KMAP_BASE + slot * PGSIZE;
+}
+
+/* Gives up KPAGE, a kernel virtual address returned by
+   kmap() or kmap_multiple(). */
+void
+kunmap (const void *kpage)
+{
+  const uint8_t *p = kpage;
+  size_t slot;
+
+  if (p < KMAP_BASE)
+    return;
+  ASSERT (pg_ofs (p) == 0);
+  slot = (p - KMAP_BASE) / PGSIZE;
+  ASSERT (slot < KMAP_PAGES && kmap_pt[slot] != 0);
+
+  /* The slot may be reused before anything reloads CR3, so its
+     TLB entry must go now. */
+  lock_acquire (&kmap_lock);
+  kmap_pt[slot] = 0;
+  asm volatile ("invlpg (%0)" : : "r" (p) : "memory");
+  lock_release (&kmap_lock);
+  sema_up (&kmap_free);
+}
+
+/* Fills in the kmap() field of STATS. */
+void
+kmap_get_stats (struct memstat *stats)
+{
+  stats->kmap_cnt = kmap_cnt;
+}
@@ -0,0 +1,23 @@
+#ifndef THREADS_KMAP_H
+#define THREADS_KMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Kernel virtual addresses through which kmap() maps pages of
+   high memory: one page table's worth, just past the mapping of
+   low memory. */
+#define KMAP_BASE ((uint8_t *) PHYS_BASE + LOWMEM_LIMIT)
+#define KMAP_PAGES (PTSPAN / PGSIZE)
+
+struct memstat;
+
+void kmap_init (uint32_t *pd);
+void *kmap (uintptr_t paddr);
+void kmap_multiple (const uintptr_t paddrs[], void *kpages[], size_t cnt);
+void kunmap (const void *kpage);
+void kmap_get_stats (struct memstat *);
+
+#endif /* threads/kmap.h */
@@ -1,12 +1,16 @@
 #include "threads/malloc.h"
 #include <debug.h>
 #include <list.h>
+#include <memstat.h>
 #include <round.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/allocprof.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
@@ -26,23 +30,66 @@
    When we free a block, we add it to its descriptor's free list.
    But if the arena that the block was in now has no in-use
    blocks, we remove all of the arena's blocks from the free list
-   and give the arena back to the page allocator.
+   and give the arena back to the page allocator.  To keep a
+   workload that repeatedly allocates and frees one block from
+   bouncing a page in and out of the page allocator, each
+   descriptor holds on to up to ARENA_IDLE_MAX entirely free
+   arenas before it starts giving them back.
+
+   Each descriptor's free list is protected by a lock, and
+   lock_acquire() is not cheap, so every thread also keeps a
+   small "magazine" of free blocks for each size class in its
+   struct thread.  malloc() pops a block from the magazine and
+   free() pushes one onto it, neither taking a lock.  Only when a
+   magazine runs empty (or full) is the descriptor's lock taken,
+   to move half a magazine's worth of blocks from (or to) the
+   free list in one batch.  A thread's magazines are emptied back
+   into the free lists when it exits.
 
    We can't handle blocks bigger than 2 kB using this scheme,
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Each descriptor also counts the blocks it hands out and takes
+   back, its live arenas, and the bytes lost by rounding requests
+   up to its block size.  malloc_get_stats() collects these for
+   the memstat system call and malloc_print_stats() prints them
+   at shutdown.  Magazines count allocations and frees locally
+   and add them to the descriptor's counters whenever they take
+   its lock, so the totals lag by at most MAG_STATS_BATCH per
+   thread. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    size_t mag_size;            /* Blocks a magazine can hold. */
+    size_t mag_batch;           /* Blocks moved per refill or drain. */
     struct list free_list;      /* List of free blocks. */
+    size_t idle_cnt;            /* Arenas with no blocks in use. */
     struct lock lock;           /* Lock. */
+
+    /* Statistics, protected by LOCK. */
+    unsigned long long alloc_cnt;       /* Blocks handed out. */
+    unsigned long long free_cnt;        /* Blocks given back. */
+    size_t arena_cnt;                   /* Arenas currently allocated. */
+    unsigned long long wasted_bytes;    /* Bytes lost to rounding up. */
   };
 
+/* Entirely free arenas a descriptor keeps before it returns
+   arenas to the page allocator. */
+#define ARENA_IDLE_MAX 1
+
+/* Bytes of free blocks a magazine holds at most. */
+#define MAG_BYTES 1024
+
+/* Allocations or frees a magazine counts before adding them to
+   its descriptor's statistics. */
+#define MAG_STATS_BATCH 256
+
 /* Magic number for detecting arena corruption. */
 #define ARENA_MAGIC 0x9a548eed
 
@@ -57,13 +104,30 @@ struct arena
 /* Free block. */
 struct block 
   {
-    struct list_elem free_elem; /* Free list element. */
+    union
+      {
+        struct list_elem free_elem;     /* Free list element. */
+        struct block *mag_next;         /* Next block in magazine. */
+      };
   };
 
 /* Our set of descriptors. */
 static struct desc descs[10];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Big block statistics.  Updated with interrupts off, because
+   big blocks may be allocated before malloc_init() runs. */
+static unsigned long long big_alloc_cnt; /* Big blocks handed out. */
+static unsigned long long big_free_cnt; /* Big blocks given back. */
+static size_t big_page_cnt;             /* Pages in live big blocks. */
+
+static void *alloc_block (size_t size);
+static void free_block (void *);
+static struct magazine *get_magazine (struct desc *);
+static bool refill_magazine (struct desc *, struct magazine *);
+static void drain_magazine (struct desc *, struct magazine *, size_t cnt);
+static void flush_magazine_stats (struct desc *, struct magazine *);
+static void release_block (struct desc *, struct block *);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -79,17 +143,30 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      d->mag_size = block_size < MAG_BYTES ? MAG_BYTES / block_size : 1;
+      d->mag_batch = DIV_ROUND_UP (d->mag_size, 2);
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
+  ASSERT (desc_cnt == MALLOC_CLASS_CNT);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  void *p = alloc_block (size);
+  allocprof_alloc (ALLOCPROF_MALLOC, p, size, __builtin_return_address (0));
+  return p;
+}
+
+/* Does the work of malloc(). */
+static void *
+alloc_block (size_t size) 
 {
   struct desc *d;
+  struct magazine *m;
   struct block *b;
   struct arena *a;
 
@@ -107,6 +184,7 @@ malloc (size_t size)
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+      enum intr_level old_level;
       a = palloc_get_multiple (0, page_cnt);
       if (a == NULL)
         return NULL;
@@ -116,40 +194,35 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+
+      old_level = intr_disable ();
+      big_alloc_cnt++;
+      big_page_cnt += page_cnt;
+      intr_set_level (old_level);
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Refill the magazine from the free list if it is empty. */
+  m = get_magazine (d);
+  if (m->cnt == 0 || m->alloc_cnt >= MAG_STATS_BATCH)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      bool ok = true;
+
+      lock_acquire (&d->lock);
+      flush_magazine_stats (d, m);
+      if (m->cnt == 0)
+        ok = refill_magazine (d, m);
+      lock_release (&d->lock);
+      if (!ok)
+        return NULL;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  /* Take the block on top of the magazine. */
+  b = m->top;
+  m->top = b->mag_next;
+  m->cnt--;
+  m->alloc_cnt++;
+  m->wasted_bytes += d->block_size - size;
   return b;
 }
 
@@ -167,7 +240,8 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  p = alloc_block (size);
+  allocprof_alloc (ALLOCPROF_MALLOC, p, size, __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -201,7 +275,9 @@ realloc (void *old_block, size_t new_size)
     }
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = alloc_block (new_size);
+      allocprof_alloc (ALLOCPROF_MALLOC, new_block, new_size,
+                       __builtin_return_address (0));
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
@@ -217,6 +293,14 @@ realloc (void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) 
+{
+  allocprof_free (p);
+  free_block (p);
+}
+
+/* Does the work of free(). */
+static void
+free_block (void *p) 
 {
   if (p != NULL)
     {
@@ -227,42 +311,234 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          struct magazine *m = get_magazine (d);
 
 #ifndef NDEBUG
           /* Clear the block to help detect use-after-free bugs. */
           memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          /* Make room in the magazine if it is full. */
+          if (m->cnt >= d->mag_size || m->free_cnt >= MAG_STATS_BATCH)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              lock_acquire (&d->lock);
+              flush_magazine_stats (d, m);
+              if (m->cnt >= d->mag_size)
+                drain_magazine (d, m, d->mag_batch);
+              lock_release (&d->lock);
             }
 
-          lock_release (&d->lock);
+          /* Put the block on top of the magazine. */
+          b->mag_next = m->top;
+          m->top = b;
+          m->cnt++;
+          m->free_cnt++;
         }
       else
         {
           /* It's a big block.  Free its pages. */
+          enum intr_level old_level = intr_disable ();
+          big_free_cnt++;
+          big_page_cnt -= a->free_cnt;
+          intr_set_level (old_level);
           palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
-
+
+/* Returns all of the blocks in the running thread's magazines to
+   their descriptors' free lists.  Called when a thread exits. */
+void
+malloc_drain_magazines (void) 
+{
+  size_t i;
+
+  for (i = 0; i < desc_cnt; i++)
+    {
+      struct desc *d = &descs[i];
+      struct magazine *m = get_magazine (d);
+
+      lock_acquire (&d->lock);
+      flush_magazine_stats (d, m);
+      drain_magazine (d, m, m->cnt);
+      lock_release (&d->lock);
+    }
+}
+
+/* Returns the running thread's magazine for descriptor D.
+   malloc() and free() must not be called from an interrupt
+   handler, since the magazine belongs to the interrupted
+   thread. */
+static struct magazine *
+get_magazine (struct desc *d) 
+{
+  ASSERT (!intr_context ());
+  return &thread_current ()->magazines[d - descs];
+}
+
+/* Moves up to D's batch size of blocks from D's free list into
+   magazine M, which must be empty, creating a new arena if the
+   free list is empty.  Returns true if successful, false if no
+   memory is available. */
+static bool
+refill_magazine (struct desc *d, struct magazine *m) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (m->cnt == 0);
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      struct arena *a;
+
+      /* Allocate a page. */
+      a = palloc_get_page (0);
+      if (a == NULL) 
+        return false;
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+      d->arena_cnt++;
+      d->idle_cnt++;
+    }
+
+  /* Move blocks from the free list into the magazine. */
+  for (i = 0; i < d->mag_batch && !list_empty (&d->free_list); i++)
+    {
+      struct block *b = list_entry (list_pop_front (&d->free_list),
+                                    struct block, free_elem);
+      struct arena *a = block_to_arena (b);
+      if (a->free_cnt-- == d->blocks_per_arena)
+        d->idle_cnt--;
+
+      b->mag_next = m->top;
+      m->top = b;
+      m->cnt++;
+    }
+  return true;
+}
+
+/* Moves CNT blocks from magazine M back to descriptor D. */
+static void
+drain_magazine (struct desc *d, struct magazine *m, size_t cnt) 
+{
+  ASSERT (lock_held_by_current_thread (&d->lock));
+  ASSERT (cnt <= m->cnt);
+
+  for (; cnt > 0; cnt--)
+    {
+      struct block *b = m->top;
+      m->top = b->mag_next;
+      m->cnt--;
+      release_block (d, b);
+    }
+}
+
+/* Adds the allocations and frees counted by magazine M to
+   descriptor D's statistics. */
+static void
+flush_magazine_stats (struct desc *d, struct magazine *m) 
+{
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  d->alloc_cnt += m->alloc_cnt;
+  d->free_cnt += m->free_cnt;
+  d->wasted_bytes += m->wasted_bytes;
+  m->alloc_cnt = m->free_cnt = m->wasted_bytes = 0;
+}
+
+/* Returns block B to descriptor D's free list.  If B's arena is
+   now entirely unused, keeps it around if D has fewer than
+   ARENA_IDLE_MAX such arenas, and otherwise frees it. */
+static void
+release_block (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      if (d->idle_cnt < ARENA_IDLE_MAX)
+        {
+          d->idle_cnt++;
+          return;
+        }
+
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      palloc_free_page (a);
+      d->arena_cnt--;
+    }
+}
+
+/* Fills in the malloc() fields of STATS.  No locks are taken,
+   so that this is safe to call from any context. */
+void
+malloc_get_stats (struct memstat *stats)
+{
+  size_t i;
+
+  stats->desc_cnt = 0;
+  for (i = 0; i < desc_cnt && i < MEMSTAT_DESC_CNT; i++)
+    {
+      const struct desc *d = &descs[i];
+      struct memstat_desc *sd = &stats->descs[stats->desc_cnt++];
+
+      sd->block_size = d->block_size;
+      sd->alloc_cnt = d->alloc_cnt;
+      sd->free_cnt = d->free_cnt;
+      sd->arena_cnt = d->arena_cnt;
+      sd->wasted_bytes = d->wasted_bytes;
+    }
+  stats->big_alloc_cnt = big_alloc_cnt;
+  stats->big_free_cnt = big_free_cnt;
+  stats->big_page_cnt = big_page_cnt;
+}
+
+/* Prints malloc() statistics, one line per size class that has
+   ever been used, plus one line for big blocks. */
+void
+malloc_print_stats (void)
+{
+  struct memstat stats;
+  size_t i;
+
+  malloc_get_stats (&stats);
+  for (i = 0; i < stats.desc_cnt; i++)
+    {
+      const struct memstat_desc *sd = &stats.descs[i];
+      if (sd->alloc_cnt == 0)
+        continue;
+      printf ("Malloc: %zu-byte blocks: %llu allocs, %llu frees, "
+              "%zu arenas, %llu bytes wasted\n",
+              sd->block_size, sd->alloc_cnt, sd->free_cnt,
+              sd->arena_cnt, sd->wasted_bytes);
+    }
+  printf ("Malloc: big blocks: %llu allocs, %llu frees, %zu pages\n",
+          stats.big_alloc_cnt, stats.big_free_cnt, stats.big_page_cnt);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -4,10 +4,29 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of malloc() size classes: 16, 32, ..., 1024 bytes. */
+#define MALLOC_CLASS_CNT 7
+
+/* A thread's private cache of free blocks of one size class.
+   Each struct thread has one per size class; see malloc.c. */
+struct magazine
+  {
+    void *top;                  /* First free block, or null. */
+    unsigned cnt;               /* Number of free blocks. */
+    unsigned alloc_cnt;         /* Allocations not yet counted. */
+    unsigned free_cnt;          /* Frees not yet counted. */
+    unsigned wasted_bytes;      /* Wasted bytes not yet counted. */
+  };
+
 void malloc_init (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void malloc_drain_magazines (void);
+
+struct memstat;
+void malloc_get_stats (struct memstat *);
+void malloc_print_stats (void);
 
 #endif /* threads/malloc.h */
@@ -2,11 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <memstat.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/allocprof.h"
+#include "threads/kmap.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -16,6 +20,12 @@
 #include "userprog/pagedir.h"
 #include "threads/pte.h"
 #include "userprog/exception.h"
+#include "vm/cleaner.h"
+#include "vm/evict.h"
+#include "vm/ksm.h"
+#include "vm/vma.h"
+#include "vm/pagecache.h"
+#include "vm/swap.h"
 
 /* Page allocator.  Hands out memory in page-size (or
    page-multiple) chunks.  See malloc.h for an allocator that
@@ -27,65 +37,175 @@
    that the kernel needs to have memory for its own operations
    even if user processes are swapping like mad.
 
-   By default, half of system RAM is given to the kernel pool and
-   half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   The kernel pool must be in low memory (see LOWMEM_LIMIT in
+   vaddr.h), where every page has a kernel virtual address.  By
+   default, half of low memory is given to the kernel pool and
+   the rest of RAM, high memory included, to the user pool, so
+   that the user pool grows with the machine's RAM.  That should
+   be huge overkill for the kernel pool, but that's just fine for
+   demonstration purposes.
+
+   Every page of the user pool also has an entry in the frame
+   table, found by subtracting the pool's first page number from
+   the page's own.  Free user pages are kept on a list threaded
+   through their frame table entries, so a single user page is
+   allocated or freed in constant time.  The used_map bitmap is
+   kept in step with the list, for multi-page allocations and
+   for statistics.  Frames in high memory have no lasting kernel
+   address: the kernel reaches them through frame_kmap(). */
 
 /* A memory pool. */
 struct pool
   {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
-    uint8_t *base;                      /* Base of pool. */
+    uintptr_t base;                     /* Physical address of base. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
-static void init_pool (struct pool *, void *base, size_t page_cnt,
-                       const char *name);
-static bool page_from_pool (const struct pool *, void *page);
+/* Frame table, one entry per page in the user pool. */
+static struct frame *frame_table;
+static size_t frame_cnt;
+
+/* Frames below this index are in low memory. */
+static size_t low_frame_cnt;
+
+/* Frames not in use, protected by user_pool.lock. */
+static struct list free_frames;
+static size_t free_frame_cnt;
+
+static void init_pool (struct pool *, void *bm_base, size_t bm_pages,
+                       uintptr_t base, size_t page_cnt, const char *name);
+static bool page_from_pool (const struct pool *, uintptr_t paddr);
+static void *get_pages (enum palloc_flags, size_t page_cnt);
+static int get_frame (void);
+static void put_frames (size_t idx, size_t cnt);
+static void pool_get_stats (const struct pool *, struct memstat_pool *);
+
+static int evict_frame(size_t);
+
+/* Broadcast, with frame_lock, whenever a page's write to swap
+   or to its mapped file finishes. */
+static struct condition io_done;
+
+/* Eviction statistics, protected by frame_lock. */
+static unsigned long long evict_cnt;       /* Pages evicted. */
+static unsigned long long evict_dirty_cnt; /* Evicted pages written out. */
+
+/* Copy-on-write faults that copied a frame, protected by
+   frame_lock. */
+static unsigned long long cow_copy_cnt;
+
+/* Same-page merging statistics, protected by frame_lock. */
+static unsigned long long merge_cnt;    /* Frames freed by merging. */
+static unsigned long long unmerge_cnt;  /* Merged pages copied on write. */
 
-static unsigned get_swap_sector(void);
+/* A kernel page of zeros, mapped read-only in place of every
+   zero-fill page that has been read but not written.  It is
+   not in the user pool, so it has no frame and is never
+   evicted. */
+static void *zero_page;
+static unsigned long long zero_map_cnt; /* Read faults it served. */
 
-static int evict_frame(void);
+/* Swap read-ahead statistics, protected by frame_lock. */
+static unsigned long long readahead_cnt;      /* Pages read ahead. */
+static unsigned long long readahead_hit_cnt;  /* ...and later used. */
+static unsigned long long readahead_miss_cnt; /* ...and evicted unused. */
 
-static int clock_hand;
+/* Swap faults without read-ahead after which a thread whose
+   window has shrunk to 1 tries read-ahead again. */
+#define READAHEAD_PROBE 32
+
+/* Fault-around window, in pages, and the most it may be set to.
+   Protected by frame_lock, like the count of pages it maps. */
+#define FAULT_AROUND_DEFAULT 16
+#define FAULT_AROUND_MAX 256
+static size_t fault_around_pages = FAULT_AROUND_DEFAULT;
+static unsigned long long fault_around_cnt;
+
+/* Stack pages mapped by page_prefault().  Protected by
+   frame_lock. */
+static unsigned long long stack_prefault_cnt;
+
+static void swap_in_cluster (struct page *, int frame_index);
+static void restore_shared_page (struct page *);
+static void fault_around (struct page *);
+static void map_zero_page (struct page *);
+static void unshare_zero_page (struct page *);
+static void frame_add_page (struct page *, int index);
+static void share_swap_slot (struct page *, struct page *);
+static void frame_set_writable (struct frame *, bool);
+static void frames_kmap (int a, int b, void *kpages[2]);
+static void copy_frame (int dst, int src);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
 void
 palloc_init (size_t user_page_limit)
 {
-  /* Free memory starts at 1 MB and runs to the end of RAM. */
-  uint8_t *free_start = ptov (1024 * 1024);
-  uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
-  size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
-  size_t kernel_pages;
+  /* Free memory starts at 1 MB and runs to the end of RAM.  Low
+     memory ends at LOWMEM_LIMIT, or at the end of RAM if that is
+     lower. */
+  uintptr_t free_start = 1024 * 1024;
+  size_t ram_pages = init_ram_pages;
+  size_t low_pages = ram_pages < LOWMEM_LIMIT / PGSIZE
+                     ? ram_pages : LOWMEM_LIMIT / PGSIZE;
+  size_t free_pages = ram_pages - free_start / PGSIZE;
+  size_t free_low_pages = low_pages - free_start / PGSIZE;
+  size_t kernel_pages = free_low_pages - free_low_pages / 2;
+  size_t user_pages = free_pages - kernel_pages;
+  size_t kernel_bm_pages, user_bm_pages;
+  uintptr_t user_start;
+  uint8_t *bm_base;
+  size_t i;
   if (user_pages > user_page_limit)
-    user_pages = user_page_limit;
-  kernel_pages = free_pages - user_pages;
+    {
+      user_pages = user_page_limit;
+      kernel_pages = free_pages - user_pages;
+      if (kernel_pages > free_low_pages)
+        kernel_pages = free_low_pages;
+    }
 
-  /* Give half of memory to kernel, half to user. */
-  init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
-  init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
-             user_pages, "user pool");
+  /* Give half of low memory to kernel, the rest to user.  Both
+     pools' bitmaps go at the start of the kernel pool: the user
+     pool may be in high memory, and until paging_init() only the
+     first 64 MB of RAM are mapped anyhow. */
+  kernel_bm_pages = DIV_ROUND_UP (bitmap_buf_size (kernel_pages), PGSIZE);
+  user_bm_pages = DIV_ROUND_UP (bitmap_buf_size (user_pages), PGSIZE);
+  if (kernel_bm_pages + user_bm_pages > kernel_pages)
+    PANIC ("Not enough memory in kernel pool for bitmaps.");
+  bm_base = ptov (free_start);
+  user_start = free_start + kernel_pages * PGSIZE;
+  kernel_pages -= kernel_bm_pages + user_bm_pages;
+  init_pool (&kernel_pool, bm_base, kernel_bm_pages,
+             free_start + (kernel_bm_pages + user_bm_pages) * PGSIZE,
+             kernel_pages, "kernel pool");
+  init_pool (&user_pool, bm_base + kernel_bm_pages * PGSIZE, user_bm_pages,
+             user_start, user_pages, "user pool");
 
-  frame_list = (struct page**)malloc(sizeof(struct page*) * FRAME_LIMIT);
+  frame_cnt = user_pages;
+  low_frame_cnt = user_start < LOWMEM_LIMIT
+                  ? (LOWMEM_LIMIT - user_start) / PGSIZE : 0;
+  if (low_frame_cnt > frame_cnt)
+    low_frame_cnt = frame_cnt;
+  if (low_frame_cnt < frame_cnt)
+    printf ("%zu user pool pages in high memory.\n",
+            frame_cnt - low_frame_cnt);
+  frame_table = get_pages (PAL_ASSERT | PAL_ZERO,
+                           DIV_ROUND_UP (frame_cnt * sizeof *frame_table,
+                                         PGSIZE));
+  list_init (&free_frames);
+  for (i = 0; i < frame_cnt; i++)
+    {
+      list_init (&frame_table[i].rmap);
+      list_push_back (&free_frames, &frame_table[i].free_elem);
+    }
+  free_frame_cnt = frame_cnt;
   lock_init(&frame_lock);
-  frame_pointer = 0;
-  clock_hand = 0;
-  lock_init(&swap_lock);
-  swap_map = (unsigned char*)malloc(sizeof(char) * SWAP_LIMIT);
-  int i;
-  for( i = 0; i < SWAP_LIMIT; i++) {
-    swap_map[i] = 0;
-  }
-  swap_pointer = 1;
-  for( i = 0; i < FRAME_LIMIT; i++) {
-    frame_list[i] = NULL;
-  }
+  cond_init(&io_done);
+  zero_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -96,20 +216,47 @@ palloc_init (size_t user_page_limit)
    FLAGS, in which case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *pages = get_pages (flags, page_cnt);
+  if (!(flags & PAL_USER))
+    allocprof_alloc (ALLOCPROF_PALLOC, pages, page_cnt * PGSIZE,
+                     __builtin_return_address (0));
+  return pages;
+}
+
+/* Does the work of palloc_get_multiple(). */
+static void *
+get_pages (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
   void *pages;
   size_t page_idx;
+  size_t i;
 
   if (page_cnt == 0)
     return NULL;
 
   lock_acquire (&pool->lock);
   page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+  if (pool == &user_pool && page_idx != BITMAP_ERROR)
+    {
+      if (page_idx + page_cnt > low_frame_cnt)
+        {
+          /* Pages of high memory have no address to return. */
+          bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+          page_idx = BITMAP_ERROR;
+        }
+      else
+        {
+          for (i = 0; i < page_cnt; i++)
+            list_remove (&frame_table[page_idx + i].free_elem);
+          free_frame_cnt -= page_cnt;
+        }
+    }
   lock_release (&pool->lock);
 
   if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
+    pages = ptov (pool->base + PGSIZE * page_idx);
   else
     pages = NULL;
 
@@ -137,7 +284,11 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 void *
 palloc_get_page (enum palloc_flags flags) 
 {
-  return palloc_get_multiple (flags, 1);
+  void *page = get_pages (flags, 1);
+  if (!(flags & PAL_USER))
+    allocprof_alloc (ALLOCPROF_PALLOC, page, PGSIZE,
+                     __builtin_return_address (0));
+  return page;
 }
 
 /* Frees the PAGE_CNT pages starting at PAGES. */
@@ -151,19 +302,27 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   if (pages == NULL || page_cnt == 0)
     return;
 
-  if (page_from_pool (&kernel_pool, pages))
+  allocprof_free (pages);
+
+  if (page_from_pool (&kernel_pool, vtop (pages)))
     pool = &kernel_pool;
-  else if (page_from_pool (&user_pool, pages))
+  else if (page_from_pool (&user_pool, vtop (pages)))
     pool = &user_pool;
   else
     NOT_REACHED ();
 
-  page_idx = pg_no (pages) - pg_no (pool->base);
+  page_idx = (vtop (pages) - pool->base) / PGSIZE;
 
 #ifndef NDEBUG
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  if (pool == &user_pool)
+    {
+      put_frames (page_idx, page_cnt);
+      return;
+    }
+
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
 }
@@ -175,236 +334,1081 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
-/* Initializes pool P as starting at START and ending at END,
-   naming it NAME for debugging purposes. */
+/* Frees the page at physical address PADDR, which unlike the
+   pages palloc_free_page() takes may be a frame in high
+   memory. */
+void
+palloc_free_phys (uintptr_t paddr)
+{
+  if (page_from_pool (&user_pool, paddr))
+    deallocate_frame_index ((paddr - user_pool.base) / PGSIZE);
+  else
+    palloc_free_page (ptov (paddr));
+}
+
+/* Takes the first frame off the free list and returns its
+   index, or -1 if no frame is free. */
+static int
+get_frame (void)
+{
+  int idx = -1;
+
+  lock_acquire (&user_pool.lock);
+  if (!list_empty (&free_frames))
+    {
+      struct list_elem *e = list_pop_front (&free_frames);
+      idx = list_entry (e, struct frame, free_elem) - frame_table;
+      bitmap_mark (user_pool.used_map, idx);
+      free_frame_cnt--;
+    }
+  lock_release (&user_pool.lock);
+  return idx;
+}
+
+/* Puts the CNT frames starting at frame IDX on the free list. */
 static void
-init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
+put_frames (size_t idx, size_t cnt)
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
-    PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  size_t i;
+
+  lock_acquire (&user_pool.lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct frame *f = &frame_table[idx + i];
+      ASSERT (f->ref_cnt == 0 && !f->pinned);
+      list_push_front (&free_frames, &f->free_elem);
+    }
+  ASSERT (bitmap_all (user_pool.used_map, idx, cnt));
+  bitmap_set_multiple (user_pool.used_map, idx, cnt, false);
+  free_frame_cnt += cnt;
+  lock_release (&user_pool.lock);
+}
 
+/* Initializes pool P as the PAGE_CNT pages starting at physical
+   address BASE, with its bitmap in the BM_PAGES pages at BM_BASE,
+   naming it NAME for debugging purposes. */
+static void
+init_pool (struct pool *p, void *bm_base, size_t bm_pages,
+           uintptr_t base, size_t page_cnt, const char *name) 
+{
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
   lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
+  p->used_map = bitmap_create_in_buf (page_cnt, bm_base, bm_pages * PGSIZE);
+  p->base = base;
 }
 
-/* Returns true if PAGE was allocated from POOL,
-   false otherwise. */
+/* Returns true if the page at physical address PADDR was
+   allocated from POOL, false otherwise. */
 static bool
-page_from_pool (const struct pool *pool, void *page) 
+page_from_pool (const struct pool *pool, uintptr_t paddr) 
 {
-  size_t page_no = pg_no (page);
-  size_t start_page = pg_no (pool->base);
+  size_t page_no = paddr / PGSIZE;
+  size_t start_page = pool->base / PGSIZE;
   size_t end_page = start_page + bitmap_size (pool->used_map);
 
   return page_no >= start_page && page_no < end_page;
 }
 
-void add_page_to_frames(struct page *p, const int index) // which file typedefs uintptr_t? :S
+/* Fills in the page allocator, frame table and swap map fields
+   of STATS.  No locks are taken, so the counts may be slightly
+   inconsistent with one another, but this is safe to call from
+   any context, including while shutting down after a panic. */
+void
+palloc_get_stats (struct memstat *stats)
 {
-  frame_list[index] = p;
+  pool_get_stats (&kernel_pool, &stats->kernel_pool);
+  pool_get_stats (&user_pool, &stats->user_pool);
+
+  stats->frame_cnt = frame_cnt;
+  stats->frame_used_cnt = stats->user_pool.used_cnt;
+  stats->frame_high_cnt = frame_cnt - low_frame_cnt;
+  kmap_get_stats (stats);
+  stats->evict_cnt = evict_cnt;
+  stats->evict_dirty_cnt = evict_dirty_cnt;
+  stats->readahead_cnt = readahead_cnt;
+  stats->readahead_hit_cnt = readahead_hit_cnt;
+  stats->readahead_miss_cnt = readahead_miss_cnt;
+  cleaner_get_stats (stats);
+  pagecache_get_stats (stats);
+  stats->cow_copy_cnt = cow_copy_cnt;
+  evict_get_stats (stats);
+  pagedir_get_stats (stats);
+  stats->ksm_merge_cnt = merge_cnt;
+  stats->ksm_unmerge_cnt = unmerge_cnt;
+  ksm_get_stats (stats);
+  stats->fault_around_cnt = fault_around_cnt;
+  stats->stack_prefault_cnt = stack_prefault_cnt;
+  stats->zero_map_cnt = zero_map_cnt;
+
+  swap_get_stats (stats);
+}
+
+/* Prints page allocator, frame table and swap map statistics. */
+void
+palloc_print_stats (void)
+{
+  struct memstat stats;
+
+  palloc_get_stats (&stats);
+  printf ("Palloc: kernel pool %zu of %zu pages free (largest run %zu), "
+          "user pool %zu of %zu pages free (largest run %zu)\n",
+          stats.kernel_pool.page_cnt - stats.kernel_pool.used_cnt,
+          stats.kernel_pool.page_cnt, stats.kernel_pool.largest_free_run,
+          stats.user_pool.page_cnt - stats.user_pool.used_cnt,
+          stats.user_pool.page_cnt, stats.user_pool.largest_free_run);
+  printf ("Frames: %zu of %zu frames used, %zu of %zu swap slots used\n",
+          stats.frame_used_cnt, stats.frame_cnt,
+          stats.swap_used_cnt, stats.swap_slot_cnt);
+  if (stats.frame_high_cnt > 0)
+    printf ("High memory: %zu frames, %llu temporary mappings\n",
+            stats.frame_high_cnt, stats.kmap_cnt);
+  printf ("Eviction: %s policy, %llu pages evicted, %llu written to swap, "
+          "%llu over allocation, %llu at hard limits\n",
+          evict_policy_name (), stats.evict_cnt, stats.evict_dirty_cnt,
+          stats.evict_over_cnt, stats.evict_hard_cnt);
+  printf ("TLB: %llu pages invalidated, %llu full flushes, "
+          "%llu invalidations batched, %llu CR3 loads, %llu skipped\n",
+          stats.tlb_invlpg_cnt, stats.tlb_flush_cnt, stats.tlb_batched_cnt,
+          stats.cr3_load_cnt, stats.cr3_skip_cnt);
+  printf ("Read-ahead: %llu pages read ahead from swap, %llu used, "
+          "%llu evicted unused\n", stats.readahead_cnt,
+          stats.readahead_hit_cnt, stats.readahead_miss_cnt);
+  printf ("Cleaner: %llu pages written to swap in %llu batches\n",
+          stats.clean_cnt, stats.clean_batch_cnt);
+  printf ("Page cache: %zu shared pages cached, %llu hits\n",
+          stats.pagecache_cnt, stats.pagecache_hit_cnt);
+  printf ("Copy-on-write: %llu pages copied\n", stats.cow_copy_cnt);
+  printf ("Page merging: %llu frames scanned, %llu merged, "
+          "%llu pages unmerged by writes\n", stats.ksm_scan_cnt,
+          stats.ksm_merge_cnt, stats.ksm_unmerge_cnt);
+  printf ("Fault-around: %zu-page window, %llu pages mapped without a "
+          "fault\n", fault_around_pages, stats.fault_around_cnt);
+  printf ("Zero page: %llu read faults mapped to the shared zero page\n",
+          stats.zero_map_cnt);
+}
+
+/* Fills in STATS with the page counts of POOL. */
+static void
+pool_get_stats (const struct pool *pool, struct memstat_pool *stats)
+{
+  size_t page_cnt = bitmap_size (pool->used_map);
+  size_t run = 0;
+  size_t i;
+
+  stats->page_cnt = page_cnt;
+  stats->used_cnt = bitmap_count (pool->used_map, 0, page_cnt, true);
+  stats->largest_free_run = 0;
+  for (i = 0; i < page_cnt; i++)
+    if (bitmap_test (pool->used_map, i))
+      run = 0;
+    else if (++run > stats->largest_free_run)
+      stats->largest_free_run = run;
+}
+
+/* Records that frame INDEX, which must hold no page, holds page
+   P, making it a candidate for eviction. */
+void add_page_to_frames(struct page *p, const int index)
+{
+  lock_acquire(&frame_lock);
+  ASSERT (frame_table[index].ref_cnt == 0);
+  frame_add_page(p, index);
+  lock_release(&frame_lock);
+}
+
+/* Adds page P to the reverse map of frame INDEX.  Must be called
+   with frame_lock held. */
+static void frame_add_page(struct page *p, int index)
+{
+  struct frame *f = &frame_table[index];
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  if (f->ref_cnt++ == 0) {
+    f->last_used = timer_ticks ();
+    f->merged = false;
+  }
+  list_push_back (&f->rmap, &p->rmap_elem);
   p->frame_index = index;
-  //printf("page %p with uaddr %p added to frames by thread id: %d\n",p, p->entry->upage,thread_current()->tid);
+  p->owner->rss++;
 }
 
+/* Forgets the frame holding page P, if any.  If P was the last
+   page mapped to the frame, the frame stays allocated and mapped
+   and is freed along with P's page directory.  Otherwise P is
+   unmapped, so that the page directory does not take the frame
+   with it.  Must be called with frame_lock held. */
+void remove_page_from_frames(struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  if (p->frame_index != -1) {
+    struct frame *f = &frame_table[p->frame_index];
+
+    list_remove (&p->rmap_elem);
+    p->owner->rss--;
+    if (--f->ref_cnt > 0) {
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+    } else if (f->inode != NULL) {
+      pagecache_remove (f->inode, f->ofs);
+      f->inode = NULL;
+    }
+    p->frame_index = -1;
+  } else if (p->zero_mapped) {
+    /* Keep pagedir_destroy() from freeing the zero page. */
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+    p->zero_mapped = false;
+  }
+}
+
+/* Returns the index of a frame for a new page of the running
+   process, evicting a page if no frame is free, or one of the
+   process's own pages if it is at its hard resident set limit.
+   The frame holds no page, so it cannot be evicted until
+   add_page_to_frames() is called on it. */
 int allocate_frame_index() {
-  lock_acquire( &frame_lock );
+  struct thread *t = thread_current();
+  size_t victim = SIZE_MAX;
   int i;
-  for( i = frame_pointer; i < FRAME_LIMIT; i++ ) {
-    if( frame_list[i] == NULL ) {
-      goto done;
-    }
+
+  lock_acquire( &frame_lock );
+  if( t->rss >= t->rss_hard ) {
+    victim = evict_select_own(frame_table, frame_cnt, t);
   }
-  for( i = 0; i < frame_pointer; i++ ) {
-    if( frame_list[i] == NULL ) {
-      goto done;
-    }
+  if( victim != SIZE_MAX ) {
+    i = evict_frame(victim);
+  } else if( (i = get_frame()) == -1 ) {
+    i = evict_frame(evict_select_victim(frame_table, frame_cnt));
   }
-  //no frames found
-  i = evict_frame();
-  done:
-    ASSERT ( frame_list[i] == NULL );
-    frame_list[i] = FRAME_MAGIC;
-    frame_pointer = i + 1;
-    lock_release( &frame_lock );
-    return i;
+  ASSERT ( frame_table[i].ref_cnt == 0 );
+  cleaner_wake();
+  lock_release( &frame_lock );
+  return i;
 }
 
+/* Returns frame INDEX, which must hold no page, to the free
+   list. */
 void deallocate_frame_index(const int index) {
-  lock_acquire( &frame_lock );
-  ASSERT (frame_list[index] == 0xDEADBEEF);
-  frame_list[index] = NULL;
-  frame_pointer = index;
-  lock_release( &frame_lock );
+  ASSERT (index >= 0 && (size_t) index < frame_cnt);
+  put_frames(index, 1);
 }
 
-static int evict_frame() {
-  ASSERT ( lock_held_by_current_thread(&frame_lock) );
+/* Returns true if frame IDX holds anonymous memory that
+   frame_merge() may merge: pages of writable private areas only,
+   none of them under I/O.  Must be called with frame_lock
+   held. */
+bool frame_is_mergeable(size_t idx) {
+  struct frame *f = &frame_table[idx];
+  struct list_elem *e;
 
-  int i;
-  struct page *p = NULL;
-  for(i = clock_hand; i < FRAME_LIMIT; i++) {
-    if(frame_list[i] != FRAME_MAGIC && !pagedir_is_accessed(frame_list[i]->owner->pagedir, frame_list[i]->upage)) {
-      goto found;
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (idx < frame_cnt);
+
+  if(f->ref_cnt == 0 || f->pinned || f->inode != NULL) {
+    return false;
+  }
+  for(e = list_begin(&f->rmap); e != list_end(&f->rmap); e = list_next(e)) {
+    struct page *p = list_entry(e, struct page, rmap_elem);
+    if(p->in_flight || p->vma->type != VMA_PRIVATE || !p->vma->writable) {
+      return false;
     }
   }
-  if( p == NULL ) {
-    for(i = 0; i < clock_hand; i++) {
-      if(frame_list[i] != FRAME_MAGIC && !pagedir_is_accessed(frame_list[i]->owner->pagedir, frame_list[i]->upage)) {
-        goto found;
-      }
+  return true;
+}
+
+/* If frames DST and SRC are both mergeable and hold the same
+   data, moves every page mapped to SRC over to DST, mapped
+   read-only, frees SRC and returns true.  Otherwise returns
+   false.  A later write to any of DST's pages faults into
+   page_unshare(), which gives the writer its own copy again.
+
+   The pages are write-protected before they are compared, so
+   that a process preempting the caller cannot change them
+   between the comparison and the merge: its write faults, and
+   waits in page_unshare() for frame_lock.  Must be called with
+   frame_lock held. */
+bool frame_merge(size_t dst, size_t src) {
+  struct frame *d = &frame_table[dst];
+  struct frame *s = &frame_table[src];
+  void *kpages[2];
+  bool same;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (dst != src);
+
+  if(!frame_is_mergeable(dst) || !frame_is_mergeable(src)) {
+    return false;
+  }
+  frame_set_writable(d, false);
+  frame_set_writable(s, false);
+  frames_kmap(dst, src, kpages);
+  same = !memcmp(kpages[0], kpages[1], PGSIZE);
+  kunmap(kpages[1]);
+  kunmap(kpages[0]);
+  if(!same) {
+    if(d->ref_cnt == 1) {
+      frame_set_writable(d, true);
     }
-    if( p == NULL ) {
-      if( clock_hand >= FRAME_LIMIT ) {
-        clock_hand = 0;
-      }
-      for(i = 0; i < FRAME_LIMIT; i++) {
-        if( frame_list[i] != FRAME_MAGIC ) {
-          goto found;
-        }
-      }
+    if(s->ref_cnt == 1) {
+      frame_set_writable(s, true);
     }
+    return false;
   }
 
-  found:
-    clock_hand = i + 1;
-    p = frame_list[i];
-    frame_list[i] = NULL;
-    frame_pointer = i;
+  /* A dirty page's data is not in its swap slot, so its dirty
+     bit must follow it to DST for eviction to write DST out. */
+  while(!list_empty(&s->rmap)) {
+    struct page *p = list_entry(list_pop_front(&s->rmap), struct page,
+                                rmap_elem);
+    uint32_t *pd = p->owner->pagedir;
+    bool dirty = pagedir_is_dirty(pd, p->upage);
 
-  void *upage = p->upage;
-  void *page = pagedir_get_page( p->owner->pagedir, upage );
-  if(pagedir_is_dirty(p->owner->pagedir, upage) || (!p->zeroed && p->file == NULL && p->sector == 0)) {
-    if( p->file != NULL ) {
-      file_close(p->file);
-      p->file = NULL;
+    p->owner->rss--;
+    pagedir_clear_page(pd, p->upage);
+    pagedir_set_phys(pd, p->upage, frame_to_phys(dst), false);
+    if(dirty) {
+      pagedir_set_dirty(pd, p->upage, true);
     }
-    p->zeroed = false;
-    struct block* swap = block_get_role(BLOCK_SWAP);
-//    printf("page table index: %u\n", pt_no(page));
-//    printf("page directory index: %u\n", pd_no(page));
-//    printf("thread pagedir: %u\n", pd_no(thread_current()->pagedir));
-//    block_sector_t sector = get_swap_sector();
-    if(p->sector == 0) {
-      p->sector = get_swap_sector();
+    frame_add_page(p, dst);
+  }
+  s->ref_cnt = 0;
+  d->merged = true;
+  deallocate_frame_index(src);
+  merge_cnt++;
+  return true;
+}
+
+/* Sets the PTEs of all the pages mapped to frame F writable if
+   WRITABLE is true, read-only otherwise. */
+static void frame_set_writable(struct frame *f, bool writable) {
+  struct list_elem *e;
+
+  for(e = list_begin(&f->rmap); e != list_end(&f->rmap); e = list_next(e)) {
+    struct page *p = list_entry(e, struct page, rmap_elem);
+    pagedir_set_writable(p->owner->pagedir, p->upage, writable);
+  }
+}
+
+/* Returns the number of frames. */
+size_t frame_count(void) {
+  return frame_cnt;
+}
+
+/* Returns the number of free frames.  No lock is taken, so the
+   count may be stale by the time the caller looks at it. */
+size_t frame_free_count(void) {
+  return free_frame_cnt;
+}
+
+/* Returns the page in frame INDEX, if it is the only page mapped
+   there and the frame is not pinned, otherwise a null pointer.
+   Must be called with frame_lock held. */
+struct page *frame_page(size_t index) {
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (index < frame_cnt);
+  f = &frame_table[index];
+  if (f->pinned || f->ref_cnt != 1) {
+    return NULL;
+  }
+  return list_entry (list_front (&f->rmap), struct page, rmap_elem);
+}
+
+/* Pins frame INDEX, so that it is neither evicted nor freed
+   while I/O to or from it is in progress without frame_lock.
+   Must be called with frame_lock held. */
+void frame_pin(size_t index) {
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (index < frame_cnt && !frame_table[index].pinned);
+  frame_table[index].pinned = true;
+}
+
+/* Unpins frame INDEX.  Must be called with frame_lock held. */
+void frame_unpin(size_t index) {
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (index < frame_cnt && frame_table[index].pinned);
+  frame_table[index].pinned = false;
+}
+
+/* Waits until page P is not being written out.  Must be
+   called with frame_lock held, which is released while
+   waiting. */
+void page_wait_io(struct page *p) {
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  while(p->in_flight) {
+    cond_wait(&io_done, &frame_lock);
+  }
+}
+
+/* Marks the write of page P finished and wakes the threads
+   waiting for it.  Must be called with frame_lock held. */
+void page_io_done(struct page *p) {
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (p->in_flight);
+  p->in_flight = false;
+  cond_broadcast(&io_done, &frame_lock);
+}
+
+/* Returns the physical address of frame INDEX. */
+uintptr_t frame_to_phys(int index) {
+  ASSERT (index >= 0 && (size_t) index < frame_cnt);
+  return user_pool.base + index * PGSIZE;
+}
+
+/* Returns a kernel virtual address for frame INDEX, which the
+   caller must give up with kunmap() once done with the frame's
+   contents. */
+void *frame_kmap(int index) {
+  return kmap(frame_to_phys(index));
+}
+
+/* Maps frames A and B, storing their kernel virtual addresses in
+   KPAGES[0] and KPAGES[1], which the caller must give up with
+   kunmap().  Takes both kmap() slots at once, since the caller
+   may hold frame_lock. */
+static void frames_kmap(int a, int b, void *kpages[2]) {
+  uintptr_t paddrs[2];
+
+  paddrs[0] = frame_to_phys(a);
+  paddrs[1] = frame_to_phys(b);
+  kmap_multiple(paddrs, kpages, 2);
+}
+
+/* Copies the contents of frame SRC into frame DST. */
+static void copy_frame(int dst, int src) {
+  void *kpages[2];
+
+  frames_kmap(dst, src, kpages);
+  memcpy(kpages[0], kpages[1], PGSIZE);
+  kunmap(kpages[1]);
+  kunmap(kpages[0]);
+}
+
+/* Returns true if P's contents would be lost if its frame were
+   simply reused, that is, if it was written since it was last
+   loaded.  Otherwise it can be loaded again from its swap slot,
+   if it has one, or else from its area. */
+bool page_is_dirty(struct page *p) {
+  return pagedir_is_dirty(p->owner->pagedir, p->upage);
+}
+
+/* Writes the CNT dirty pages in PAGES[], whose contents are at
+   KPAGES[], back to where they will be read from: mapped pages
+   to their files and the rest to swap.  CNT must not exceed
+   SWAP_CLUSTER_MAX. */
+void write_pages_back(struct page *pages[], const void *kpages[],
+                      size_t cnt) {
+  struct page *swap_pages[SWAP_CLUSTER_MAX];
+  const void *swap_kpages[SWAP_CLUSTER_MAX];
+  size_t swap_cnt = 0;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER_MAX);
+
+  for(i = 0; i < cnt; i++) {
+    if(pages[i]->vma->type == VMA_SHARED) {
+      vma_write_page(pages[i]->vma, pages[i]->upage, kpages[i]);
+    } else {
+      swap_pages[swap_cnt] = pages[i];
+      swap_kpages[swap_cnt] = kpages[i];
+      swap_cnt++;
     }
-//    printf("sector: %u\n", sector);
+  }
+  if(swap_cnt > 0) {
+    write_pages_to_swap(swap_pages, swap_kpages, swap_cnt);
+  }
+}
+
+/* Writes the CNT pages in PAGES[], whose contents are at
+   KPAGES[], to swap.  From then on each page is loaded from
+   swap rather than from its area, and its old swap slot, whose
+   contents are stale, is freed.  The pages are put
+   in consecutive slots if possible, so they can be written, and
+   later read back, with one request. */
+void write_pages_to_swap(struct page *pages[], const void *kpages[],
+                         size_t cnt) {
+  size_t slot = swap_alloc(cnt);
+  size_t i;
+
+  for(i = 0; i < cnt; i++) {
+    struct page *p = pages[i];
+    if(p->swap_slot != SWAP_NONE) {
+      swap_free(p->swap_slot, 1);
+      p->swap_slot = SWAP_NONE;
+    }
+  }
+
+  if(slot != SWAP_NONE) {
+    for(i = 0; i < cnt; i++) {
+      pages[i]->swap_slot = slot + i;
+    }
+    swap_write_pages(slot, kpages, cnt);
+  } else {
+    for(i = 0; i < cnt; i++) {
+      pages[i]->swap_slot = swap_alloc(1);
+      if(pages[i]->swap_slot == SWAP_NONE) {
+        PANIC ("out of swap slots");
+      }
+      swap_write(pages[i]->swap_slot, kpages[i]);
+    }
+  }
+  swap_write_cnt += cnt;
+}
 
-    int i;
-    for( i = 0; i < 8; i++) {
-      block_write(swap, p->sector + i, page + i * 512);
+/* Evicts the pages mapped to frame I, chosen by the replacement
+   policy, writing them to swap if necessary, and returns I.
+
+   The victim is unmapped before its dirty bit is examined, so
+   that its owner cannot modify it any more, and frame_lock is
+   dropped for the duration of the swap write, so that other
+   threads can fault in and evict pages meanwhile.  The frame is
+   pinned until then, and the page is marked in flight, which
+   makes its owner wait in restore_page() if it faults on the
+   page before the write is done. */
+static int evict_frame(size_t i) {
+  ASSERT ( lock_held_by_current_thread(&frame_lock) );
+
+  struct frame *f = &frame_table[i];
+  struct page *p = NULL;
+  struct list_elem *e;
+  evict_cnt++;
+
+  /* Unmap every page mapped to the frame.  Clearing a mapping
+     leaves its dirty bit alone.  If any of the pages is dirty,
+     the frame must be written out. */
+  for(e = list_begin(&f->rmap); e != list_end(&f->rmap); e = list_next(e)) {
+    struct page *q = list_entry(e, struct page, rmap_elem);
+    if(q->readahead) {
+      page_readahead_done(q, pagedir_is_accessed(q->owner->pagedir,
+                                                 q->upage));
+    }
+    q->frame_index = -1;
+    pagedir_clear_page( q->owner->pagedir, q->upage);
+    if(p == NULL && page_is_dirty(q)) {
+      p = q;
     }
-    swap_write_cnt++;
+  }
+  if(f->inode != NULL) {
+    pagecache_remove(f->inode, f->ofs);
+    f->inode = NULL;
   }
 
-  p->frame_index = -1;
-//  printf("uaddr %p swapped to sector %u by thread id: %d\n", upage, sector, f->placer->tid);
-//  unsigned *kvals = (unsigned*)page;
-//  unsigned *uvals = (unsigned*)upage;
-//  printf("kernel: %x %x %x %x\n", *kvals, *(kvals+1), *(kvals+2), *(kvals+3));
-  //printf("user: %x %x %x %x\n", *uvals, *(uvals+1), *(uvals+2), *(uvals+3));
-//  p->swapped = 1;
+  if(p != NULL) {
+    const void *kpage;
 
+    /* Write the frame out once, on behalf of P.  Every page that
+       was mapped to it is in flight until then.  Mapped file
+       pages are never shared, so the others, which were shared
+       copy-on-write by fork(), go to swap and share P's slot. */
+    ASSERT (p->vma->type == VMA_PRIVATE || f->ref_cnt == 1);
+    frame_pin(i);
+    for(e = list_begin(&f->rmap); e != list_end(&f->rmap); e = list_next(e)) {
+      list_entry(e, struct page, rmap_elem)->in_flight = true;
+    }
+    lock_release(&frame_lock);
+    kpage = frame_kmap(i);
+    write_pages_back(&p, &kpage, 1);
+    kunmap(kpage);
+    lock_acquire(&frame_lock);
+    for(e = list_begin(&f->rmap); e != list_end(&f->rmap); e = list_next(e)) {
+      struct page *q = list_entry(e, struct page, rmap_elem);
+      if(q != p) {
+        share_swap_slot(q, p);
+      }
+    }
+    frame_unpin(i);
+    evict_dirty_cnt++;
+  }
 
-  pagedir_clear_page( p->owner->pagedir, upage);
-  palloc_free_page( page );
+  while(!list_empty(&f->rmap)) {
+    struct page *q = list_entry(list_pop_front(&f->rmap), struct page,
+                                rmap_elem);
+    q->owner->rss--;
+    if(q->in_flight) {
+      page_io_done(q);
+    }
+  }
+  f->ref_cnt = 0;
   return i;
 }
 
-static unsigned get_swap_sector() {
-  lock_acquire(&swap_lock);
-  unsigned i;
-  for( i = swap_pointer; i < (SWAP_LIMIT); i++ ) {
-    if( !swap_map[i] ) {
-      swap_map[i] = 1;
-      swap_pointer++;
-      lock_release(&swap_lock);
-      return i<<3;
-    }
+/* Makes page Q, which has the same contents as page P, share
+   P's swap slot. */
+static void share_swap_slot(struct page *q, struct page *p) {
+  ASSERT (p->swap_slot != SWAP_NONE);
+
+  if(q->swap_slot != SWAP_NONE) {
+    swap_free(q->swap_slot, 1);
   }
-  lock_release(&swap_lock);
-  return -1;
+  q->swap_slot = swap_dup(p->swap_slot);
 }
 
-void restore_page( struct page *p ) {
+/* Brings page P, on which the running thread faulted, into
+   memory.  WRITE is true if the fault was for a write. */
+void restore_page( struct page *p, bool write ) {
   ASSERT ( p != NULL );
 
+  /* P may have been unmapped by a thread that is still writing
+     it to swap.  Its swap slot is not valid until that's done.
+     Or P may have been unmapped only for a moment, by a thread
+     holding frame_lock that was moving it to another frame, as
+     frame_merge() does.  Then P is mapped again by now, and the
+     fault needs nothing more. */
+  lock_acquire(&frame_lock);
+  page_wait_io(p);
+  if( p->frame_index != -1 || p->zero_mapped ) {
+    lock_release(&frame_lock);
+    return;
+  }
+  lock_release(&frame_lock);
+
+  if( !write && p->swap_slot == SWAP_NONE && p->vma->type == VMA_PRIVATE
+      && vma_page_is_zero(p->vma, p->upage) ) {
+    map_zero_page( p );
+    return;
+  }
+  if( p->swap_slot == SWAP_NONE && !p->vma->writable
+      && vma_page_in_file(p->vma, p->upage) ) {
+    restore_shared_page( p );
+    return;
+  }
+
   int frame_index = allocate_frame_index();
 
-  uint8_t *kpage = palloc_get_page( PAL_USER );
+  if( p->swap_slot != SWAP_NONE ) {
+    swap_in_cluster(p, frame_index);
+  } else {
+    uint8_t *kpage = frame_kmap( frame_index );
+    if( vma_read_page(p->vma, p->upage, kpage) ) {
+      demand_cnt++;
+    } else {
+      zero_cnt++;
+    }
+    kunmap( kpage );
+  }
 
-  if(kpage == NULL) {
-    kpage = palloc_get_page(0);
+  pagedir_set_phys( thread_current()->pagedir, p->upage,
+                    frame_to_phys( frame_index ), p->vma->writable);
+//  pagedir_set_accessed( thread_current()->pagedir, p->upage, false );
+//  pagedir_set_dirty( thread_current()->pagedir, p->upage, false );
+  add_page_to_frames(p, frame_index);
+//  printf("done restoring\n");
+}
+
+/* Maps zero-fill page P, on which the running thread took a
+   read fault, to the shared zero page, read-only.  A later
+   write faults into page_unshare(). */
+static void map_zero_page(struct page *p) {
+  lock_acquire(&frame_lock);
+  if(pagedir_set_page(thread_current()->pagedir, p->upage, zero_page,
+                      false)) {
+    p->zero_mapped = true;
+    zero_map_cnt++;
   }
-//  printf("kpage: %p\n", kpage);
-//  printf("restoring page %p\n", p->upage);
+  lock_release(&frame_lock);
+}
 
+/* Gives page P, which is mapped to the shared zero page and
+   which the running thread is writing, a zeroed frame of its
+   own, mapped writable. */
+static void unshare_zero_page(struct page *p) {
+  uint32_t *pd = p->owner->pagedir;
+  int frame_index = allocate_frame_index();
+  void *kpage = frame_kmap(frame_index);
+
+  memset(kpage, 0, PGSIZE);
+  kunmap(kpage);
+  lock_acquire(&frame_lock);
+  pagedir_clear_page(pd, p->upage);
+  p->zero_mapped = false;
+  pagedir_set_phys(pd, p->upage, frame_to_phys(frame_index), true);
+  frame_add_page(p, frame_index);
+  zero_cnt++;
+  lock_release(&frame_lock);
+}
 
-  ASSERT ( kpage != NULL );
+/* Brings read-only file page P into memory, mapping the frame
+   of the same page of the same file if another process already
+   has it in the page cache, and otherwise reading it into a new
+   frame and caching that.  Then maps whatever neighbours of P
+   the page cache has too, by fault_around(). */
+static void restore_shared_page(struct page *p) {
+  struct inode *inode = file_get_inode(p->vma->file);
+  off_t ofs = vma_page_ofs(p->vma, p->upage);
+  int frame_index;
 
-  if( p->zeroed ) {
-//  printf("restoring zeroed page %p\n", p->upage);
-//    printf("restoring zeroed page\n");
-//    p->zeroed = false;
-    memset( kpage, 0, PGSIZE );
-    zero_cnt++;
-  } else if ( p->file != NULL ) {
-//  printf("restoring demand page %p\n", p->upage);
-//    printf("demand paging\n");
-    file_seek(p->file, p->ofs);
-    if (file_read (p->file, kpage, PGSIZE) != (int) PGSIZE) {
+  lock_acquire(&frame_lock);
+  frame_index = pagecache_lookup(inode, ofs);
+  if(frame_index == -1) {
+    struct frame *f;
+    void *kpage;
+    int cached;
+
+    lock_release(&frame_lock);
+    frame_index = allocate_frame_index();
+    kpage = frame_kmap(frame_index);
+    if(file_read_at(p->vma->file, kpage, PGSIZE, ofs) != (int) PGSIZE) {
       PANIC("file read size mismatch\n");
     }
-//    unsigned *pvals = kpage;
-//    printf("demanded page: %x %x %x %x\n",*pvals, *(pvals+1), *(pvals+2), *(pvals+3));
-//    if(!p->readonly) {
-//      file_close(p->file);
-//      p->file = NULL;
-//    }
+    kunmap(kpage);
     demand_cnt++;
-//    file_close(p->file);
-  } else {
-//  printf("restoring swapped page %p\n", p->upage);
-
-//    printf("restoring swapped page\n");
-//    ASSERT ( p->swapped );
-    struct block* swap = block_get_role(BLOCK_SWAP);
-    block_sector_t sector = p->sector;
-
-    //printf("thread %d is restoring page uaddr: %p from sector %u\n", thread_current()->tid, p->entry->upage, sector);
-    int i;
-    for( i = 0; i < 8; i++ ) {
-      // what is the destination of this read from block? We need to load the data from disk/exec file
-      // into the designated frame page rather than the VM page.
-      block_read( swap, sector + i, kpage + i * 512 );
-    }
-    /*lock_acquire( &swap_lock );
-    unsigned swap_index = sector>>3;
-    swap_map[swap_index] = 0;
-    if(swap_index < swap_pointer) {
-      swap_pointer = swap_index;
-    }
-    lock_release( &swap_lock );
-    */
-  //  unsigned *kvals = (unsigned*)kpage;
-  //  unsigned *uvals = (unsigned*)upage;
-  //  printf("kernel: %x %x %x %x\n", *kvals, *(kvals+1), *(kvals+2), *(kvals+3));
-  //  printf("user: %x %x %x %x\n", *uvals, *(uvals+1), *(uvals+2), *(uvals+3));
-    swap_read_cnt++;
-  }
-
-  pagedir_set_page( thread_current()->pagedir, p->upage, kpage, !p->readonly);
-//  pagedir_set_accessed( thread_current()->pagedir, p->upage, false );
-//  pagedir_set_dirty( thread_current()->pagedir, p->upage, false );
-  add_page_to_frames(p, frame_index);
-//  printf("done restoring\n");
+    lock_acquire(&frame_lock);
+
+    /* Another process may have read the same page meanwhile. */
+    cached = pagecache_lookup(inode, ofs);
+    if(cached != -1) {
+      deallocate_frame_index(frame_index);
+      frame_index = cached;
+    } else if(pagecache_insert(inode, ofs, frame_index)) {
+      f = &frame_table[frame_index];
+      f->inode = inode;
+      f->ofs = ofs;
+    }
+  }
+
+  pagedir_set_phys(thread_current()->pagedir, p->upage,
+                   frame_to_phys(frame_index), false);
+  frame_add_page(p, frame_index);
+  fault_around(p);
+  lock_release(&frame_lock);
 }
 
+/* Maps the pages around read-only file page P, which has just
+   been faulted in, that are in the page cache but not yet in
+   the running thread's address space.  Each one saves a fault
+   later if it is used, and costs no I/O and no frame if it is
+   not.  The window is the aligned run of fault_around_pages
+   pages that contains P, cut to P's area.  The pages are mapped
+   with their accessed bits clear, so the replacement policy
+   does not take them for recently used.  Must be called with
+   frame_lock held. */
+static void fault_around(struct page *p) {
+  struct thread *t = thread_current();
+  struct vma *vma = p->vma;
+  struct inode *inode = file_get_inode(vma->file);
+  uint8_t *start, *end, *upage;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if(fault_around_pages <= 1) {
+    return;
+  }
+  start = (uint8_t *) p->upage
+          - pg_no(p->upage) % fault_around_pages * PGSIZE;
+  end = start + fault_around_pages * PGSIZE;
+  if(start < vma->start) {
+    start = vma->start;
+  }
+  if(end > vma->end || end < start) {
+    end = vma->end;
+  }
+
+  for(upage = start; upage < end; upage += PGSIZE) {
+    struct page *q;
+    int frame_index;
+
+    if(t->rss >= t->rss_hard) {
+      break;
+    }
+    if(upage == p->upage || !vma_page_in_file(vma, upage)) {
+      continue;
+    }
+    q = get_page(upage);
+    if(q != NULL && (q->frame_index != -1 || q->in_flight
+                     || q->swap_slot != SWAP_NONE)) {
+      continue;
+    }
+    frame_index = pagecache_lookup(inode, vma_page_ofs(vma, upage));
+    if(frame_index == -1) {
+      continue;
+    }
+    if(q == NULL && (q = init_page(upage, vma)) == NULL) {
+      break;
+    }
+    if(!pagedir_set_phys(t->pagedir, upage, frame_to_phys(frame_index),
+                         false)) {
+      break;
+    }
+    frame_add_page(q, frame_index);
+    fault_around_cnt++;
+  }
+}
+
+/* Sets the fault-around window to PAGE_CNT pages, or turns
+   fault-around off if PAGE_CNT is 0 or 1.  Returns false if
+   PAGE_CNT is too large. */
+bool palloc_set_fault_around(size_t page_cnt) {
+  if(page_cnt > FAULT_AROUND_MAX) {
+    return false;
+  }
+  fault_around_pages = page_cnt;
+  return true;
+}
+
+/* Maps a zeroed frame of its own, writable, at each page from
+   START up to END of anonymous area VMA that the running thread
+   has never touched, so that its stack can grow into them
+   without faulting.  Only free frames are used, and only while
+   the thread is under its hard resident set limit: a page that
+   may never be used is not worth an eviction.  The pages are
+   mapped with their accessed bits clear, so the replacement
+   policy does not take them for recently used. */
+void page_prefault(struct vma *vma, uint8_t *start, uint8_t *end) {
+  struct thread *t = thread_current();
+  uint8_t *upage;
+
+  ASSERT (vma->file == NULL && vma->writable);
+
+  for(upage = start; upage < end; upage += PGSIZE) {
+    struct page *p;
+    void *kpage;
+    int frame_index;
+
+    if(get_page(upage) != NULL) {
+      continue;
+    }
+    lock_acquire(&frame_lock);
+    frame_index = t->rss < t->rss_hard ? get_frame() : -1;
+    lock_release(&frame_lock);
+    if(frame_index == -1) {
+      break;
+    }
+    kpage = frame_kmap(frame_index);
+    memset(kpage, 0, PGSIZE);
+    kunmap(kpage);
+
+    lock_acquire(&frame_lock);
+    p = init_page(upage, vma);
+    if(p == NULL || !pagedir_set_phys(t->pagedir, upage,
+                                      frame_to_phys(frame_index), true)) {
+      lock_release(&frame_lock);
+      deallocate_frame_index(frame_index);
+      break;
+    }
+    frame_add_page(p, frame_index);
+    stack_prefault_cnt++;
+    lock_release(&frame_lock);
+  }
+}
+
+/* Adds to the running thread's address space a copy of page PP
+   of its parent, for fork().  Nothing is copied: if PP is in a
+   frame, the new page is mapped to the same frame, and if PP is
+   writable, both are mapped read-only, so that the first write
+   to either one faults into page_unshare().  If PP has a swap
+   slot, the new page shares it.  PP must belong to a private
+   area, which the running thread must already have a copy of.
+   Returns false if memory runs out.  Must be called with
+   frame_lock held. */
+bool page_fork(struct page *pp) {
+  struct thread *t = thread_current();
+  uint32_t *ppd = pp->owner->pagedir;
+  struct page *p;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (pp->vma->type == VMA_PRIVATE);
+
+  page_wait_io(pp);
+  p = init_page(pp->upage, vma_find(t, pp->upage));
+  if(p == NULL) {
+    return false;
+  }
+  if(pp->swap_slot != SWAP_NONE) {
+    p->swap_slot = swap_dup(pp->swap_slot);
+  }
+  if(pp->frame_index != -1) {
+    if(!pagedir_set_phys(t->pagedir, p->upage,
+                         frame_to_phys(pp->frame_index), false)) {
+      return false;
+    }
+    /* If PP is dirty, the frame's contents are not in its swap
+       slot or file, and the same goes for the new page. */
+    if(pagedir_is_dirty(ppd, pp->upage)) {
+      pagedir_set_dirty(t->pagedir, p->upage, true);
+    }
+    if(pp->vma->writable) {
+      pagedir_set_writable(ppd, pp->upage, false);
+    }
+    frame_add_page(p, pp->frame_index);
+  } else if(pp->zero_mapped) {
+    if(!pagedir_set_page(t->pagedir, p->upage, zero_page, false)) {
+      return false;
+    }
+    p->zero_mapped = true;
+  }
+  return true;
+}
+
+/* Handles a write fault on writable page P, which is mapped
+   read-only because it is mapped to the shared zero page or
+   because fork() or page merging left its frame shared.  In the first case, P
+   gets a zeroed frame.  In the second, if other pages still
+   map the frame, P gets a copy of its own; otherwise P simply
+   takes the frame over.  Either way P ends
+   up mapped writable, unless it was evicted meanwhile, in which
+   case the write faults again and restore_page() brings it
+   back. */
+void page_unshare(struct page *p) {
+  uint32_t *pd = p->owner->pagedir;
+  int frame_index = -1;
+
+  ASSERT (p->vma->writable);
+
+  if(p->zero_mapped) {
+    unshare_zero_page(p);
+    return;
+  }
+
+  lock_acquire(&frame_lock);
+  for(;;) {
+    struct frame *f;
+
+    page_wait_io(p);
+    if(p->frame_index == -1) {
+      break;
+    }
+    f = &frame_table[p->frame_index];
+    if(f->ref_cnt == 1) {
+      pagedir_set_writable(pd, p->upage, true);
+      break;
+    }
+    if(frame_index == -1) {
+      /* Allocating a frame can evict pages, including P, so look
+         again afterward. */
+      lock_release(&frame_lock);
+      frame_index = allocate_frame_index();
+      lock_acquire(&frame_lock);
+      continue;
+    }
+
+    copy_frame(frame_index, p->frame_index);
+    list_remove(&p->rmap_elem);
+    p->owner->rss--;
+    f->ref_cnt--;
+    pagedir_clear_page(pd, p->upage);
+    pagedir_set_phys(pd, p->upage, frame_to_phys(frame_index), true);
+    frame_add_page(p, frame_index);
+    frame_index = -1;
+    cow_copy_cnt++;
+    if(f->merged) {
+      unmerge_cnt++;
+    }
+    break;
+  }
+  if(frame_index != -1) {
+    deallocate_frame_index(frame_index);
+  }
+  lock_release(&frame_lock);
+}
+
+
+/* Reads page P from swap into frame FRAME_INDEX.
+
+   The pages that follow P in the running thread's address space
+   are often in the swap slots that follow P's, because they were
+   evicted together.  As many of them as fit in the thread's
+   read-ahead window are read by the same request into frames of
+   their own and mapped without their accessed bits set, so that
+   touching them later takes no fault.  page_readahead_done()
+   judges whether that was worthwhile and adjusts the window. */
+static void swap_in_cluster(struct page *p, int frame_index) {
+  struct thread *t = thread_current();
+  struct page *pages[SWAP_RA_MAX];
+  int frames[SWAP_RA_MAX];
+  uintptr_t paddrs[SWAP_RA_MAX];
+  void *kpages[SWAP_RA_MAX];
+  size_t cnt, i;
+
+  ASSERT (t->ra_window >= 1 && t->ra_window <= SWAP_RA_MAX);
+
+  /* Find the run of following pages in the following slots.
+     Pages still being written out are left for a later fault. */
+  lock_acquire(&frame_lock);
+  pages[0] = p;
+  for(cnt = 1; cnt < t->ra_window; cnt++) {
+    uint8_t *upage = (uint8_t *) p->upage + cnt * PGSIZE;
+    struct page *q = get_page(upage);
+    if(q == NULL || q->frame_index != -1 || q->in_flight
+       || q->swap_slot != p->swap_slot + cnt) {
+      break;
+    }
+    pages[cnt] = q;
+  }
+
+  /* A thread whose read-ahead was shut off for being useless
+     tries again now and then, in case its access pattern has
+     changed. */
+  if(t->ra_window == 1 && ++t->ra_idle >= READAHEAD_PROBE) {
+    t->ra_window = 2;
+    t->ra_idle = 0;
+  }
+  lock_release(&frame_lock);
+
+  /* Get every frame before mapping any, since
+     allocate_frame_index() waits for frame_lock, which must not
+     be done holding kmap() slots. */
+  frames[0] = frame_index;
+  for(i = 0; i < cnt; i++) {
+    if(i > 0) {
+      frames[i] = allocate_frame_index();
+    }
+    paddrs[i] = frame_to_phys(frames[i]);
+  }
+  kmap_multiple(paddrs, kpages, cnt);
+  swap_read_pages(p->swap_slot, kpages, cnt);
+  swap_read_cnt += cnt;
+  for(i = 0; i < cnt; i++) {
+    kunmap(kpages[i]);
+  }
+
+  for(i = 1; i < cnt; i++) {
+    struct page *q = pages[i];
+    if(!pagedir_set_phys(t->pagedir, q->upage, frame_to_phys(frames[i]),
+                         q->vma->writable)) {
+      deallocate_frame_index(frames[i]);
+      continue;
+    }
+    q->readahead = true;
+    add_page_to_frames(q, frames[i]);
+  }
+
+  if(cnt > 1) {
+    lock_acquire(&frame_lock);
+    readahead_cnt += cnt - 1;
+    lock_release(&frame_lock);
+  }
+}
+
+/* Records whether page P, which was read ahead from swap, was
+   used (HIT) before it was evicted.  Once as many outcomes as
+   its owner's read-ahead window have been seen, the window is
+   doubled if at least three quarters were hits and halved if
+   fewer than one quarter were.  Must be called with frame_lock
+   held. */
+void page_readahead_done(struct page *p, bool hit) {
+  struct thread *t = p->owner;
+  unsigned total;
+
+  ASSERT (lock_held_by_current_thread(&frame_lock));
+  ASSERT (p->readahead);
+
+  p->readahead = false;
+  if(hit) {
+    t->ra_hits++;
+    readahead_hit_cnt++;
+  } else {
+    t->ra_misses++;
+    readahead_miss_cnt++;
+  }
+
+  total = t->ra_hits + t->ra_misses;
+  if(total >= t->ra_window) {
+    if(t->ra_hits * 4 >= total * 3 && t->ra_window < SWAP_RA_MAX) {
+      t->ra_window *= 2;
+    } else if(t->ra_hits * 4 < total && t->ra_window > 1) {
+      t->ra_window /= 2;
+    }
+    t->ra_hits = t->ra_misses = 0;
+    t->ra_idle = 0;
+  }
+}
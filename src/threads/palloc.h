@@ -2,6 +2,7 @@
 #define THREADS_PALLOC_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <list.h>
 #include <hash.h>
 #include "threads/synch.h"
@@ -15,40 +16,79 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
-#define FRAME_LIMIT 500
-#define SWAP_LIMIT 1<<13
-#define FRAME_MAGIC 0xDEADBEEF
-
+/* A page of a process's virtual memory area that has been
+   touched: one that is in a frame or has a swap slot, or has
+   been at some point.  The area gives its initial contents. */
 struct page
 {
-  bool readonly;
-  bool zeroed;
-  uint32_t sector;
+  struct vma *vma;              /* Area the page belongs to. */
+  size_t swap_slot;             /* Swap slot, or SWAP_NONE. */
+  bool readahead;               /* Read ahead from swap, not yet used. */
+  bool in_flight;               /* Being written out. */
+  bool zero_mapped;             /* Mapped to the shared zero page. */
   struct thread *owner;
   void* upage;
-  struct hash_elem elem;
-  struct file *file;
-  off_t ofs;
   int frame_index;
+  struct list_elem rmap_elem;   /* Element in frame's RMAP. */
 };
 
-unsigned char *swap_map;
-struct lock swap_lock;
-unsigned int swap_pointer;
+/* A frame: one physical page of the user pool, which may be in
+   high memory.  The frame table has one entry per user pool
+   page, indexed by the page's physical frame number relative to
+   the start of the pool.
+
+   A frame is normally mapped by a single page, but a read-only
+   file page in the page cache is mapped by one page in each
+   process that uses it.  RMAP, the reverse map, lists them all,
+   so that evicting the frame can unmap every alias. */
+struct frame
+  {
+    struct list rmap;           /* Pages mapped to this frame. */
+    size_t ref_cnt;             /* Number of pages in RMAP. */
+    struct list_elem free_elem; /* Element in the free frame list. */
+    int64_t last_used;          /* Timer ticks when last seen in use. */
+    bool pinned;                /* Under I/O, must not be reused. */
+    struct inode *inode;        /* Page cache key, if cached: file... */
+    off_t ofs;                  /* ...and offset within it. */
+    bool merged;                /* Pages merged in by vm/ksm.c. */
+  };
 
-struct page **frame_list;
 struct lock frame_lock;
-int frame_pointer;
 
 void add_page_to_frames(struct page*, const int);
+void remove_page_from_frames(struct page*);
 int allocate_frame_index(void);
 void deallocate_frame_index(const int);
-void restore_page(struct page*);
+size_t frame_count(void);
+size_t frame_free_count(void);
+struct page *frame_page(size_t);
+void frame_pin(size_t);
+void frame_unpin(size_t);
+bool frame_is_mergeable(size_t);
+bool frame_merge(size_t dst, size_t src);
+uintptr_t frame_to_phys(int);
+void *frame_kmap(int);
+void restore_page(struct page*, bool write);
+bool page_fork(struct page*);
+void page_unshare(struct page*);
+void page_prefault(struct vma *, uint8_t *start, uint8_t *end);
+bool page_is_dirty(struct page*);
+void write_pages_to_swap(struct page *[], const void *[], size_t);
+void write_pages_back(struct page *[], const void *[], size_t);
+void page_readahead_done(struct page*, bool hit);
+void page_wait_io(struct page*);
+void page_io_done(struct page*);
+bool palloc_set_fault_around(size_t);
 
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+void palloc_free_phys (uintptr_t paddr);
+
+struct memstat;
+void palloc_get_stats (struct memstat *);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
@@ -66,6 +66,8 @@ static inline uintptr_t pd_no (const void *va) {
 #define PTE_U 0x4               /* 1=user/kernel, 0=kernel only. */
 #define PTE_A 0x20              /* 1=accessed, 0=not acccessed. */
 #define PTE_D 0x40              /* 1=dirty, 0=not dirty (PTEs only). */
+#define PTE_PS 0x80             /* 1=4 MB page (PDEs only). */
+#define PTE_G 0x100             /* 1=global, kept across CR3 loads. */
 
 /* Returns a PDE that points to page table PT. */
 static inline uint32_t pde_create (uint32_t *pt) {
@@ -73,20 +75,40 @@ static inline uint32_t pde_create (uint32_t *pt) {
   return vtop (pt) | PTE_U | PTE_P | PTE_W;
 }
 
+/* Returns a PDE that maps the 4 MB page at PAGE directly, with
+   no page table, for use by the kernel only.  The PDE's page is
+   readable and writable.  Requires page size extensions (CR4.PSE)
+   to be enabled. */
+static inline uint32_t pde_create_large (void *page) {
+  ASSERT ((uintptr_t) page % PTSPAN == 0);
+  return vtop (page) | PTE_PS | PTE_P | PTE_W;
+}
+
 /* Returns a pointer to the page table that page directory entry
-   PDE, which must "present", points to. */
+   PDE, which must "present" and not map a 4 MB page, points
+   to. */
 static inline uint32_t *pde_get_pt (uint32_t pde) {
   ASSERT (pde & PTE_P);
   return ptov (pde & PTE_ADDR);
 }
 
+/* Returns a PTE that points to the page at physical address
+   PADDR, which may be in high memory.
+   The PTE's page is readable.
+   If WRITABLE is true then it will be writable as well.
+   The page will be usable only by ring 0 code (the kernel). */
+static inline uint32_t pte_create_phys (uintptr_t paddr, bool writable) {
+  ASSERT ((paddr & PGMASK) == 0);
+  return paddr | PTE_P | (writable ? PTE_W : 0);
+}
+
 /* Returns a PTE that points to PAGE.
    The PTE's page is readable.
    If WRITABLE is true then it will be writable as well.
    The page will be usable only by ring 0 code (the kernel). */
 static inline uint32_t pte_create_kernel (void *page, bool writable) {
   ASSERT (pg_ofs (page) == 0);
-  return vtop (page) | PTE_P | (writable ? PTE_W : 0);
+  return pte_create_phys (vtop (page), writable);
 }
 
 /* Returns a PTE that points to PAGE.
@@ -98,10 +120,16 @@ static inline uint32_t pte_create_user (void *page, bool writable) {
 }
 
 /* Returns a pointer to the page that page table entry PTE points
-   to. */
+   to, which must be in low memory. */
 static inline void *pte_get_page (uint32_t pte) {
   return ptov (pte & PTE_ADDR);
 }
 
+/* Returns the physical address of the page that page table entry
+   PTE points to. */
+static inline uintptr_t pte_get_phys (uint32_t pte) {
+  return pte & PTE_ADDR;
+}
+
 #endif /* threads/pte.h */
 
@@ -14,7 +14,12 @@
 #include "threads/vaddr.h"
 #include "threads/malloc.h"
 #ifdef USERPROG
+#include "userprog/pagedir.h"
 #include "userprog/process.h"
+#include "vm/evict.h"
+#include "vm/mmap.h"
+#include "vm/swap.h"
+#include "vm/vma.h"
 #endif
 
 /* Random value for struct thread's `magic' member.
@@ -74,9 +79,7 @@ static void *alloc_frame (struct thread *, size_t size);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
-static unsigned page_hash_func(const struct hash_elem*, void*);
-static bool page_less_func(const struct hash_elem*, const struct hash_elem*, void*);
-static void page_destructor(struct hash_elem *e, void *aux UNUSED);
+static void page_destructor(struct page *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -220,10 +223,19 @@ thread_create (const char *name, int priority,
   t->load_status = 0;
   sema_init(&t->loaded, 0);
   sema_init(&t->exit, 0);
-  t->stack_pages = 0;
+#ifdef USERPROG
+  t->ra_window = SWAP_RA_INIT;
+  t->rss_soft = thread_current()->rss_soft;
+  t->rss_hard = thread_current()->rss_hard;
+  t->rss_alloc = t->rss_soft;
+  list_init(&t->vmas);
+  t->next_mapid = 0;
+  t->stack_limit = thread_current()->stack_limit;
+  t->stack_window = 1;
+#endif
   /* Add to run queue. */
   thread_unblock (t);
-  hash_init(&t->page_table, page_hash_func, page_less_func, NULL);
+  spt_init(&t->page_table);
   if( !intr_context() && t->priority > thread_current()->priority ) {
       thread_yield();
   }
@@ -324,16 +336,22 @@ thread_exit (void)
 
 #ifdef USERPROG
   bool acquired = false;
+  struct pagedir_batch batch;
   if(!lock_held_by_current_thread(&frame_lock)) {
     acquired = true;
     lock_acquire(&frame_lock);
   }
-  hash_destroy(&thread_current()->page_table, page_destructor);
+  pagedir_batch_begin(&batch);
+  mmap_unmap_all();
+  spt_destroy(&thread_current()->page_table, page_destructor);
+  vma_destroy_all();
+  pagedir_batch_end(&batch);
   if(acquired) {
     lock_release(&frame_lock);
   }
   process_exit ();
 #endif
+  malloc_drain_magazines ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
@@ -346,20 +364,11 @@ thread_exit (void)
   NOT_REACHED ();
 }
 
-static void page_destructor(struct hash_elem *e, void *aux UNUSED) {
-  struct page *entry = hash_entry (e, struct page, elem);
-  if( entry->frame_index != -1 ) {
-    frame_list[entry->frame_index] = NULL;
-    frame_pointer = entry->frame_index;
-  }
-  if(entry->file != NULL) {
-    file_close(entry->file);
-  }
-  if(entry->sector != 0) {
-    swap_map[entry->sector] = 0;
-    if(entry->sector < swap_pointer) {
-      swap_pointer = entry->sector;
-    }
+static void page_destructor(struct page *entry) {
+  page_wait_io(entry);
+  remove_page_from_frames(entry);
+  if(entry->swap_slot != SWAP_NONE) {
+    swap_free(entry->swap_slot, 1);
   }
   free(entry);
 }
@@ -556,6 +565,10 @@ init_thread (struct thread *t, const char *name, int priority)
   t->original_priority = -1;
   t->waiting = NULL;
   list_push_back (&all_list, &t->allelem);
+#ifdef USERPROG
+  t->rss_hard = RSS_UNLIMITED;
+  t->stack_limit = STACK_LIMIT;
+#endif
   //t->sup_table = bitmap_create(PAGE_LIMIT);
 }
 
@@ -692,58 +705,28 @@ struct thread* thread_get_by_id(tid_t tid) {
   return NULL; 
 }
 
-static unsigned page_hash_func(const struct hash_elem* a, void* aux UNUSED) {
-  return hash_entry(a, struct page, elem)->upage;
-}
-
-static bool page_less_func(const struct hash_elem* a, const struct hash_elem* b, void* aux UNUSED) {
-  return page_hash_func(a, aux) < page_hash_func(b, aux);
-}
-
-struct page* init_page(void *upage, bool readonly, bool zeroed, struct file *f, off_t ofs) {
+/* Creates the running thread's page UPAGE of area VMA.  Returns
+   the new page, or a null pointer if memory is short. */
+struct page* init_page(void *upage, struct vma *vma) {
   struct page *p = (struct page*) malloc(sizeof (struct page));
-//  printf("malloced page: %p for upage %p readonly: %d\n",p,upage,readonly);
-//  if( !p ) {
-//    printf("size: %u\n", hash_size(&thread_current()->page_table));
-//  }
-//  p->swapped = 0;
-  p->readonly = readonly;
-  p->zeroed = zeroed;
-  p->sector = 0;
+  if(p == NULL) {
+    return NULL;
+  }
+  p->vma = vma;
+  p->swap_slot = SWAP_NONE;
+  p->readahead = false;
+  p->in_flight = false;
+  p->zero_mapped = false;
   p->frame_index = -1;
   p->owner = thread_current();
   p->upage = upage;
-//  printf("upage: %p zeroed: %d\n", upage, p->zeroed);
-  if(f != NULL ) {
-    p->file = file_reopen(f);
-    p->ofs = ofs;
-  } else {
-    p->file = NULL;
+  if(!spt_insert(&thread_current()->page_table, p)) {
+    free(p);
+    return NULL;
   }
-  struct hash_elem *elem = hash_replace( &thread_current()->page_table, &p->elem );
-/*  if( elem != NULL ) {
-    struct page *existing = hash_entry(elem, struct page, elem);
-    if(existing->frame != NULL) {
-      lock_acquire(&frame_lock);
-      delete_frame(existing->frame);
-      lock_release(&frame_lock);
-    }
-    free(existing);
-  }*/
-//  ASSERT ( elem == NULL );
   return p;
 }
 
 struct page* get_page(void *upage) {
-  struct page entry;
-  entry.upage = (void*) ((uintptr_t)upage & 0xFFFFF000);
-  size_t size = hash_size(&thread_current()->page_table);
-  if ( size > 0 ) {
-    struct hash_elem *entry_in_table = hash_find( &thread_current()->page_table, &entry.elem );
-    if(entry_in_table == NULL) {
-      return NULL;
-    }
-    return hash_entry( entry_in_table, struct page, elem );
-  }
-  return NULL;
+  return spt_find(&thread_current()->page_table, upage);
 }
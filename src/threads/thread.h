@@ -6,8 +6,10 @@
 #include <list.h>
 #include <stdint.h>
 #include <threads/synch.h>
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "filesys/file.h"
+#include "vm/spt.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -28,6 +30,7 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Default limit on the size of a process's stack, in pages. */
 #define STACK_LIMIT (1<<11)
 
 /* A kernel thread or user process.
@@ -108,6 +111,7 @@ struct thread
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
+    struct pagedir_batch *pd_batch;     /* Deferred TLB invalidations. */
 #endif
     struct semaphore loaded; // used to sync the loading in exec()
     int load_status;
@@ -122,8 +126,31 @@ struct thread
     struct file *fds[16];               // keeps track of just this thread's currently open files.  Necessary to prevent child processes from inheriting the files
     struct file *exec;                  // the file that the current process is currently running; tracks if program can write to this process or not
 
-    struct hash page_table;
-    unsigned short stack_pages;
+    struct spt page_table;              /* Supplemental page table. */
+
+    /* Swap read-ahead, owned by threads/palloc.c. */
+    unsigned ra_window;                 /* Pages read per swap fault. */
+    unsigned ra_hits;                   /* Read-ahead pages used... */
+    unsigned ra_misses;                 /* ...and wasted, this round. */
+    unsigned ra_idle;                   /* Swap faults with no read-ahead. */
+
+    /* Resident set, owned by vm/evict.c.  Protected by
+       frame_lock. */
+    size_t rss;                         /* Pages mapped to frames. */
+    size_t rss_soft;                    /* Least allocation. */
+    size_t rss_hard;                    /* Most resident pages. */
+    size_t rss_alloc;                   /* Allocation, by fault rate. */
+    int64_t last_fault;                 /* Ticks at last page fault. */
+
+    /* Address space, owned by vm/vma.c. */
+    struct list vmas;                   /* Areas, sorted by address. */
+    int next_mapid;                     /* Next mapping identifier. */
+    size_t stack_limit;                 /* Most stack pages, for exec. */
+    unsigned stack_window;              /* Stack pages per stack fault. */
+    void *user_esp;                     /* User esp at system call. */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine magazines[MALLOC_CLASS_CNT]; /* Cached free blocks. */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -165,7 +192,8 @@ bool priority_cmp(const struct list_elem *, const struct list_elem *, void *);
 
 struct thread* thread_get_by_id(tid_t);
 
-struct page* init_page(void*, bool, bool, struct file*, off_t);
+struct vma;
+struct page* init_page(void*, struct vma*);
 struct page* get_page(void*);
 
 #endif /* threads/thread.h */
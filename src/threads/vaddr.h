@@ -52,6 +52,12 @@ static inline void *pg_round_down (const void *va) {
    virtual address space belongs to the kernel. */
 #define	PHYS_BASE ((void *) LOADER_PHYS_BASE)
 
+/* Only physical memory below this address, "low memory", is
+   mapped at PHYS_BASE: the kernel has just 1 GB of virtual
+   address space, and the top of it is kept for threads/kmap.c,
+   which maps pages of the rest, "high memory", temporarily. */
+#define LOWMEM_LIMIT 0x38000000         /* 896 MB. */
+
 /* Returns true if VADDR is a user virtual address. */
 static inline bool
 is_user_vaddr (const void *vaddr) 
@@ -66,22 +72,23 @@ is_kernel_vaddr (const void *vaddr)
   return vaddr >= PHYS_BASE;
 }
 
-/* Returns kernel virtual address at which physical address PADDR
-   is mapped. */
+/* Returns kernel virtual address at which physical address PADDR,
+   which must be in low memory, is mapped. */
 static inline void *
 ptov (uintptr_t paddr)
 {
-  ASSERT ((void *) paddr < PHYS_BASE);
+  ASSERT (paddr < LOWMEM_LIMIT);
 
   return (void *) (paddr + PHYS_BASE);
 }
 
-/* Returns physical address at which kernel virtual address VADDR
-   is mapped. */
+/* Returns physical address at which kernel virtual address VADDR,
+   which must be in the mapping of low memory, is mapped. */
 static inline uintptr_t
 vtop (const void *vaddr)
 {
   ASSERT (is_kernel_vaddr (vaddr));
+  ASSERT ((uintptr_t) vaddr - (uintptr_t) PHYS_BASE < LOWMEM_LIMIT);
 
   return (uintptr_t) vaddr - (uintptr_t) PHYS_BASE;
 }
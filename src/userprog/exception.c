@@ -1,5 +1,6 @@
 #include "userprog/exception.h"
 #include <inttypes.h>
+#include <memstat.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
 #include "threads/interrupt.h"
@@ -8,10 +9,17 @@
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
+#include "vm/evict.h"
+#include "vm/vma.h"
+#include "vm/zswap.h"
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
+/* Number of page faults that grew a user stack. */
+static long long stack_grow_cnt;
+
 static void kill (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
@@ -64,12 +72,39 @@ exception_init (void)
   intr_register_int (14, 0, INTR_OFF, page_fault, "#PF Page-Fault Exception");
 }
 
+/* Fills in the paging activity fields of STATS. */
+void
+exception_get_stats (struct memstat *stats)
+{
+  stats->page_fault_cnt = page_fault_cnt;
+  stats->stack_grow_cnt = stack_grow_cnt;
+  stats->swap_read_cnt = swap_read_cnt;
+  stats->swap_write_cnt = swap_write_cnt;
+  zswap_get_stats (stats);
+}
+
 /* Prints exception statistics. */
 void
 exception_print_stats (void) 
 {
+  struct memstat stats;
+
   printf ("Exception: %lld page faults, %lld zero reads, %lld demand reads, %lld swap reads, %lld swap writes\n", 
                       page_fault_cnt,   zero_cnt,        demand_cnt,        swap_read_cnt,   swap_write_cnt);
+
+  palloc_get_stats (&stats);
+  printf ("Stack growth: %lld faults, %llu pages pre-faulted\n",
+          stack_grow_cnt, stats.stack_prefault_cnt);
+
+  zswap_get_stats (&stats);
+  if (stats.zswap_page_cnt > 0)
+    printf ("Swap cache: %llu pages compressed, %llu rejected, "
+            "%llu hits, %llu misses, %llu spilled, "
+            "%zu pages held in %zu bytes\n",
+            stats.zswap_store_cnt, stats.zswap_reject_cnt,
+            stats.zswap_hit_cnt, stats.zswap_miss_cnt,
+            stats.zswap_spill_cnt, stats.zswap_stored_cnt,
+            stats.zswap_stored_bytes);
 }
 
 /* Handler for an exception (probably) caused by a user process. */
@@ -131,6 +166,7 @@ page_fault (struct intr_frame *f)
   bool write;        /* True: access was write, false: access was read. */
   bool user;         /* True: access by user, false: access by kernel. */
   void *fault_addr;  /* Fault address. */
+  void *esp;         /* User stack pointer. */
 
   /* Obtain faulting address, the virtual address that was
      accessed to cause the fault.  It may point to code or to
@@ -153,19 +189,27 @@ page_fault (struct intr_frame *f)
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
 
+  /* A fault in the kernel is in a system call, which saved the
+     user's stack pointer on entry. */
+  esp = user ? f->esp : thread_current ()->user_esp;
+
   /* To implement virtual memory, delete the rest of the function
      body, and replace it with code that brings in the page to
      which fault_addr refers. */
 
   //debug_backtrace_all();
 
-  struct page* page = get_page(fault_addr);
-  if ( page == NULL || page->readonly && write ) 
+  struct page* page = vma_fault_page(fault_addr);
+  if ( page == NULL && vma_grow_stack(fault_addr, esp) ) {
+    stack_grow_cnt++;
+    page = vma_fault_page(fault_addr);
+  }
+  if ( page == NULL || !page->vma->writable && write ) 
   {
     //palloc_free_page(fault_addr);
-    if( fault_addr < f->ebp && fault_addr > (f->esp - (2<<6)) && add_stack()) {
-//      printf("grow stack\n");
-//      add_stack();
+    if( !user && uaccess_fixup(f) ) {
+      /* A system call was passed a bad pointer.  The routine in
+         userprog/uaccess.c that touched it reports failure. */
     } else {
 /*  printf ("Page fault at %p by %s id:%d: %s error %s page in %s context.\n",
           fault_addr,
@@ -183,11 +227,19 @@ page_fault (struct intr_frame *f)
     }
     //    kill(f);
   }
+  else if ( !not_present && write ) {
+    /* A write to a writable page that is present but mapped
+       read-only: it is mapped to the shared zero page, or its
+       frame is shared copy-on-write since fork() or since
+       vm/ksm.c merged it with another. */
+    page_unshare( page );
+  }
   else {
 //    printf("page found \n");
     // locate the faulting address in the supplemental page table
     // use the corresponding entry to (locate the data that goes in the page)
-    restore_page( page ); // update the PTE as valid in memory instead of creating a new page
+    evict_page_fault();
+    restore_page( page, write ); // update the PTE as valid in memory instead of creating a new page
   }
 
 /*How page fault handler works? 
@@ -11,7 +11,10 @@ long long swap_read_cnt;
 long long demand_cnt;
 long long zero_cnt;
 
+struct memstat;
+
 void exception_init (void);
+void exception_get_stats (struct memstat *);
 void exception_print_stats (void);
 
 #endif /* userprog/exception.h */
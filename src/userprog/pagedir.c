@@ -2,12 +2,23 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include <memstat.h>
 #include "threads/init.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+
+/* TLB invalidation statistics. */
+static unsigned long long invlpg_cnt;   /* Single pages invalidated. */
+static unsigned long long flush_cnt;    /* Whole TLB flushes. */
+static unsigned long long batched_cnt;  /* Invalidations deferred. */
+static unsigned long long cr3_load_cnt; /* Page directories loaded. */
+static unsigned long long cr3_skip_cnt; /* ...or already active. */
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *vpage);
+static void flush_tlb (void);
+static void load_cr3 (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -23,7 +34,7 @@ pagedir_create (void)
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references, including frames in high memory. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
@@ -41,7 +52,7 @@ pagedir_destroy (uint32_t *pd)
         
         for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
           if (*pte & PTE_P) 
-            palloc_free_page (pte_get_page (*pte));
+            palloc_free_phys (pte_get_phys (*pte));
         palloc_free_page (pt);
       }
   palloc_free_page (pd);
@@ -97,13 +108,23 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
    failed. */
 bool
 pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
+{
+  ASSERT (pg_ofs (kpage) == 0);
+  return pagedir_set_phys (pd, upage, vtop (kpage), writable);
+}
+
+/* Like pagedir_set_page(), but maps UPAGE to the frame at
+   physical address PADDR, which may be in high memory, where
+   frames have no kernel virtual address to pass. */
+bool
+pagedir_set_phys (uint32_t *pd, void *upage, uintptr_t paddr, bool writable)
 {
   uint32_t *pte;
 
   ASSERT (pg_ofs (upage) == 0);
-  ASSERT (pg_ofs (kpage) == 0);
+  ASSERT ((paddr & PGMASK) == 0);
   ASSERT (is_user_vaddr (upage));
-  ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+  ASSERT (paddr >> PTSHIFT < init_ram_pages);
   ASSERT (pd != init_page_dir);
 
   pte = lookup_page (pd, upage, true);
@@ -113,7 +134,7 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
   if (pte != NULL) 
     {
       ASSERT ((*pte & PTE_P) == 0);
-      *pte = pte_create_user (kpage, writable);
+      *pte = pte_create_phys (paddr, writable) | PTE_U;
       return true;
     }
   else
@@ -122,10 +143,21 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
 
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
-   corresponding to that physical address, or a null pointer if
-   UADDR is unmapped. */
+   corresponding to that physical address, which must be in low
+   memory, or a null pointer if UADDR is unmapped. */
 void *
 pagedir_get_page (uint32_t *pd, const void *uaddr) 
+{
+  uintptr_t paddr = pagedir_get_phys (pd, uaddr);
+
+  return paddr != 0 ? ptov (paddr) : NULL;
+}
+
+/* Returns the physical address that corresponds to user virtual
+   address UADDR in PD, or 0 if UADDR is unmapped.  (Physical
+   address 0 is never part of a user page.) */
+uintptr_t
+pagedir_get_phys (uint32_t *pd, const void *uaddr)
 {
   uint32_t *pte;
 
@@ -136,9 +168,9 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
 //  printf("upage: %p\n", uaddr);
 
   if (pte != NULL && (*pte & PTE_P) != 0)
-    return pte_get_page (*pte) + pg_ofs (uaddr);
+    return pte_get_phys (*pte) + pg_ofs (uaddr);
   else
-    return NULL;
+    return 0;
 }
 
 /* Marks user virtual page UPAGE "not present" in page
@@ -157,7 +189,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -185,7 +217,28 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
+        }
+    }
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD, leaving the accessed and dirty bits alone. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      /* A stale read-only TLB entry needs no invalidation: a
+         write through it faults, and the CPU drops the entry
+         before reporting the fault. */
+      if (writable)
+        *pte |= PTE_W;
+      else
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -214,25 +267,40 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, unless it is already there. */
 void
 pagedir_activate (uint32_t *pd) 
 {
   if (pd == NULL)
     pd = init_page_dir;
 
-  /* Store the physical address of the page directory into CR3
-     aka PDBR (page directory base register).  This activates our
-     new page tables immediately.  See [IA32-v2a] "MOV--Move
-     to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
-     Address of the Page Directory". */
-  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  if (pd != active_pd ())
+    load_cr3 (pd);
+  else
+    cr3_skip_cnt++;
+}
+
+/* Makes page directory PD, which belongs to a thread being
+   switched to, active.  A null PD belongs to a kernel thread.
+   Kernel threads use only kernel mappings, which every page
+   directory shares, so they run on whichever page directory is
+   already active, and a switch from a process to a kernel thread
+   and back costs no CR3 loads at all.  This is safe because a
+   process switches to init_page_dir before destroying its own
+   page directory in process_exit(). */
+void
+pagedir_switch (uint32_t *pd)
+{
+  if (pd == NULL)
+    cr3_skip_cnt++;
+  else
+    pagedir_activate (pd);
 }
 
 /* Returns the currently active page directory. */
@@ -248,21 +316,122 @@ active_pd (void)
   return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Starts deferring the TLB invalidations that the running
+   thread's page table changes call for into batch B, until
+   pagedir_batch_end().  Meant for loops that change many PTEs,
+   such as unmapping a region or sweeping accessed bits, so that
+   they can end with one TLB flush instead of one invalidation
+   per page.
+
+   Between the two calls, the TLB may hold stale entries for the
+   changed pages, so the caller must not touch them through user
+   addresses.  A batch begun inside another one joins the outer
+   batch.
+
+   The caller may block in the middle.  That is safe because the
+   only stale TLB entries are for pages the batch has yet to
+   invalidate, and no other thread can use them meanwhile.
+   - A kernel thread switched to keeps running on the running
+     thread's page directory, since pagedir_switch() loads no
+     CR3 for it, but it never touches user addresses.  Any PTE
+     it changes itself is invalidated at once, because the batch
+     belongs to the thread that began it.
+   - A switch to another process loads CR3, which drops the
+     stale entries.  So does the switch back. */
+void
+pagedir_batch_begin (struct pagedir_batch *b)
+{
+  struct thread *t = thread_current ();
+
+  b->page_cnt = 0;
+  b->nested = t->pd_batch != NULL;
+  if (!b->nested)
+    t->pd_batch = b;
+}
+
+/* Ends batch B, carrying out the invalidations it deferred: one
+   by one if there are few, otherwise by flushing the TLB. */
+void
+pagedir_batch_end (struct pagedir_batch *b)
+{
+  size_t i;
+
+  if (b->nested)
+    return;
+  ASSERT (thread_current ()->pd_batch == b);
+  thread_current ()->pd_batch = NULL;
+
+  if (b->page_cnt > PAGEDIR_BATCH_PAGES)
+    flush_tlb ();
+  else
+    for (i = 0; i < b->page_cnt; i++)
+      {
+        asm volatile ("invlpg (%0)" : : "r" (b->pages[i]) : "memory");
+        invlpg_cnt++;
+      }
+}
+
+/* Fills in the TLB invalidation fields of STATS. */
+void
+pagedir_get_stats (struct memstat *stats)
+{
+  stats->tlb_invlpg_cnt = invlpg_cnt;
+  stats->tlb_flush_cnt = flush_cnt;
+  stats->tlb_batched_cnt = batched_cnt;
+  stats->cr3_load_cnt = cr3_load_cnt;
+  stats->cr3_skip_cnt = cr3_skip_cnt;
+}
+
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB's
+   entry for the page.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
+   This function invalidates VPAGE's entry if PD is the active
+   page directory, with INVLPG, or defers it to the running
+   thread's batch, if it has one.  (If PD is not active then its
+   entries are not in the TLB, so there is no need to invalidate
+   anything.)  See [IA32-v3a] 3.12 "Translation Lookaside Buffers
+   (TLBs)". */
 static void
-invalidate_pagedir (uint32_t *pd) 
+invalidate_page (uint32_t *pd, const void *vpage)
 {
-  if (active_pd () == pd) 
+  struct pagedir_batch *b;
+
+  if (active_pd () != pd)
+    return;
+
+  b = thread_current ()->pd_batch;
+  if (b != NULL)
     {
-      /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-         "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
-    } 
+      if (b->page_cnt < PAGEDIR_BATCH_PAGES)
+        b->pages[b->page_cnt] = vpage;
+      b->page_cnt++;
+      batched_cnt++;
+      return;
+    }
+
+  asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+  invlpg_cnt++;
+}
+
+/* Flushes the TLB's entries for user pages by reloading CR3.
+   Global entries, which map the kernel, survive. */
+static void
+flush_tlb (void)
+{
+  load_cr3 (active_pd ());
+  flush_cnt++;
+}
+
+/* Stores the physical address of page directory PD into CR3 aka
+   PDBR (page directory base register).  This activates our new
+   page tables immediately.  See [IA32-v2a] "MOV--Move to/from
+   Control Registers" and [IA32-v3a] 3.7.5 "Base Address of the
+   Page Directory". */
+static void
+load_cr3 (uint32_t *pd)
+{
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  cr3_load_cnt++;
 }
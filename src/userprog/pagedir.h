@@ -2,17 +2,40 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+struct memstat;
+
+/* Most pages a batch invalidates one by one.  A batch with more
+   flushes the whole TLB instead. */
+#define PAGEDIR_BATCH_PAGES 32
+
+/* TLB invalidations deferred by pagedir_batch_begin(). */
+struct pagedir_batch
+  {
+    bool nested;                        /* Inside another batch? */
+    size_t page_cnt;                    /* Invalidations deferred. */
+    const void *pages[PAGEDIR_BATCH_PAGES]; /* Their pages, if few. */
+  };
+
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
+bool pagedir_set_phys (uint32_t *pd, void *upage, uintptr_t paddr, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
+uintptr_t pagedir_get_phys (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_switch (uint32_t *pd);
+
+void pagedir_batch_begin (struct pagedir_batch *);
+void pagedir_batch_end (struct pagedir_batch *);
+void pagedir_get_stats (struct memstat *);
 
 #endif /* userprog/pagedir.h */
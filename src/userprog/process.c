@@ -19,6 +19,7 @@
 #include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "vm/vma.h"
 
 
 #define CMD_LIMIT 1024    /* Size limit of the command line     */
@@ -26,7 +27,20 @@ char cmdstore[CMD_LIMIT]; /* Temporary storage for command line */
 
 
 static thread_func start_process NO_RETURN;
+static thread_func start_fork NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static bool copy_address_space (struct thread *parent);
+static spt_action_func fork_page;
+
+/* What a process being created by fork() needs from its
+   parent. */
+struct fork_args
+  {
+    struct thread *parent;      /* Process being forked. */
+    struct intr_frame if_;      /* Parent's user registers. */
+    struct semaphore done;      /* Upped once the copy is made. */
+    bool success;               /* Whether the copy succeeded. */
+  };
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -152,6 +166,108 @@ start_process (void *file_name_)
   NOT_REACHED ();
 }
 
+/* Starts a new process that is a copy of the running one and
+   resumes from system call frame F, with fork() returning 0 in
+   the copy.  Returns the new process's thread id, or TID_ERROR
+   if it could not be created.  Does not return until the copy's
+   address space has been set up. */
+tid_t
+process_fork (struct intr_frame *f)
+{
+  struct fork_args args;
+  tid_t tid;
+
+  args.parent = thread_current ();
+  args.if_ = *f;
+  sema_init (&args.done, 0);
+  args.success = false;
+
+  tid = thread_create (thread_name (), PRI_DEFAULT, start_fork, &args);
+  if (tid == TID_ERROR)
+    return TID_ERROR;
+  sema_down (&args.done);
+  return args.success ? tid : TID_ERROR;
+}
+
+/* A thread function that makes the running thread a copy of the
+   process described by ARGS_ and starts it running. */
+static void
+start_fork (void *args_)
+{
+  struct fork_args *args = args_;
+  struct thread *parent = args->parent;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = args->if_;
+  bool success = false;
+  int i;
+
+  t->pagedir = pagedir_create ();
+  if (t->pagedir != NULL)
+    {
+      process_activate ();
+      success = copy_address_space (parent);
+    }
+  if (success)
+    {
+      /* Open files are reopened at the same positions, not
+         shared. */
+      for (i = 0; i < 16; i++)
+        if (parent->fds[i] != NULL)
+          {
+            t->fds[i] = file_reopen (parent->fds[i]);
+            if (t->fds[i] != NULL)
+              file_seek (t->fds[i], file_tell (parent->fds[i]));
+          }
+      if (parent->exec != NULL)
+        {
+          t->exec = file_reopen (parent->exec);
+          if (t->exec != NULL)
+            file_deny_write (t->exec);
+        }
+    }
+
+  /* ARGS lives on the parent's stack, which is gone once the
+     parent wakes up. */
+  args->success = success;
+  sema_up (&args->done);
+  if (!success)
+    {
+      statuses[t->tid] = -1;
+      thread_exit ();
+    }
+
+  if_.eax = 0;
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the running process a copy of PARENT's address space.
+   The private areas, the stack among them, are copied by
+   vma_fork(), and the pages of them that have been touched are
+   shared copy-on-write by page_fork().  Memory-mapped files are
+   not inherited. */
+static bool
+copy_address_space (struct thread *parent)
+{
+  bool success;
+
+  if (!vma_fork (parent))
+    return false;
+
+  lock_acquire (&frame_lock);
+  success = spt_for_each (&parent->page_table, fork_page, NULL);
+  lock_release (&frame_lock);
+  return success;
+}
+
+/* spt_for_each() action for copy_address_space(): copies parent
+   page PP, unless it is a page of a memory-mapped file. */
+static bool
+fork_page (struct page *pp, void *aux UNUSED)
+{
+  return pp->vma->type != VMA_PRIVATE || page_fork (pp);
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -208,7 +324,7 @@ process_activate (void)
   struct thread *t = thread_current ();
 
   /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  pagedir_switch (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
@@ -414,8 +530,6 @@ load (const char *file_name, void (**eip) (void), void **esp)
 
 /* load() helpers. */
 
-static bool install_page (void *upage, void *kpage, bool writable);
-
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
 static bool
@@ -483,127 +597,22 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0); 
 
-  file_seek (file, ofs);
-  while (read_bytes > 0 || zero_bytes > 0) 
-    {
-      /* Calculate how to fill this page.
-         We will read PAGE_READ_BYTES bytes from FILE
-         and zero the final PAGE_ZERO_BYTES bytes. */
-      size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-      size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-      if( frame_pointer > 10 /*magiclol*/ && !page_read_bytes ) {
-          init_page(upage, !writable, 1, NULL, 0);
-      } else if( page_read_bytes == PGSIZE ) {
-          init_page(upage, !writable, 0, file, ofs);
-          ofs += page_read_bytes;
-          file_seek(file, ofs);
-      } else {
-
-      int frame_index = allocate_frame_index();
-
-      /* Get a page of memory. */
-      uint8_t *kpage = palloc_get_page (PAL_USER);
-      // if page not found, page fault
-      if (kpage == NULL) {
-//        printf("cheater cheater pumpkin eater\n");
-        kpage = palloc_get_page(0);
-        if(kpage == NULL) {
-          deallocate_frame_index(frame_index);
-//        printf("PGSIZE: %d\n", PGSIZE);
-//        printf("read bytes: %u\n", page_read_bytes);
-//        printf("zero bytes: %u\n", page_zero_bytes);
-          printf("unable to allocate page");
-          return false;
-        }
-      }
-
-      /* Load this page. */
-      if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          deallocate_frame_index(frame_index);
-          printf("file not read\n");
-          return false;
-        }
-      memset (kpage + page_read_bytes, 0, page_zero_bytes);
-
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable))
-        {
-          palloc_free_page (kpage);
-          deallocate_frame_index(frame_index);
-          printf("unable to install page\n");
-          return false;
-        }
-
-//      if(!page_zero_bytes) {
-//        unsigned *pvals = kpage;
-//        printf("demand page: %x %x %x %x\n",*pvals, *(pvals+1), *(pvals+2), *(pvals+3));
-//      }
-      struct page *p = init_page(upage, !writable, 0, NULL, 0);
-      add_page_to_frames(p, frame_index);
-      }
-      /* Advance. */
-      read_bytes -= page_read_bytes;
-      zero_bytes -= page_zero_bytes;
-      upage += PGSIZE;
-    }
-  return true;
+  /* Nothing is loaded yet: the segment becomes a virtual memory
+     area, whose pages are read or zeroed when first touched. */
+  return vma_create (upage, (read_bytes + zero_bytes) / PGSIZE,
+                     read_bytes > 0 ? file : NULL, ofs, read_bytes,
+                     writable, VMA_PRIVATE) != NULL;
 }
 
-/* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
+/* Create a minimal stack: an area of one page at the top of
+   user virtual memory, which grows down on faults as far as the
+   process's stack limit allows. */
 static bool
 setup_stack (void **esp) 
 {
-  bool success = add_stack();
+  bool success = vma_create_stack () != NULL;
   if (success) {
     *esp = PHYS_BASE;
   }
   return success;
 }
-
-bool
-add_stack () {
-  uint8_t *kpage;
-  bool success = false;
-
-  struct thread *t = thread_current();
-  if( t->stack_pages < STACK_LIMIT ) {
-    t->stack_pages++;
-    kpage = palloc_get_page (PAL_USER | PAL_ZERO);
-    if(kpage == NULL) {
-      kpage = palloc_get_page(PAL_ZERO);
-    }
-    if (kpage != NULL)
-    {
-      success = install_page (((uint8_t *) PHYS_BASE) - (t->stack_pages * PGSIZE), kpage, true);
-      if(!success) {
-        palloc_free_page (kpage);
-        t->stack_pages--;
-      }
-    }
-  }
-  return success;
-}
-
-/* Adds a mapping from user virtual address UPAGE to kernel
-   virtual address KPAGE to the page table.
-   If WRITABLE is true, the user process may modify the page;
-   otherwise, it is read-only.
-   UPAGE must not already be mapped.
-   KPAGE should probably be a page obtained from the user pool
-   with palloc_get_page().
-   Returns true on success, false if UPAGE is already mapped or
-   if memory allocation fails. */
-static bool
-install_page (void *upage, void *kpage, bool writable)
-{
-  struct thread *t = thread_current ();
-
-  /* Verify that there's not already a page at that virtual
-     address, then map our page there. */
-  return (pagedir_get_page (t->pagedir, upage) == NULL
-          && pagedir_set_page (t->pagedir, upage, kpage, writable));
-}
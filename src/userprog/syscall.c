@@ -1,6 +1,7 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <debug.h>
+#include <memstat.h>
 #include <syscall-nr.h>
 #include "threads/thread.h"
 #include "filesys/filesys.h"
@@ -12,8 +13,13 @@
 #include "devices/input.h"
 #include "threads/interrupt.h"
 #include <list.h>
+#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "userprog/process.h"
+#include "userprog/uaccess.h"
+#include "vm/evict.h"
+#include "vm/mmap.h"
+#include "vm/vma.h"
 
 static int get_next_fd(void);
 
@@ -23,21 +29,102 @@ syscall_init (void)
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
-/* Makes sure that p is a user-virtual address, non-null, and already mapped into physical memory */
-bool is_valid_addr(void *p) {
-//  printf("invalid addr: %p\n", p);
-  return p != NULL && is_user_vaddr(p) /*&& pagedir_get_page(thread_current()->pagedir, p) != NULL*/;
+/* Copies the first CNT arguments of the system call in F from
+   the user stack into ARGS.  Returns false if the user stack
+   pointer is bad. */
+static bool get_args(struct intr_frame *f, uint32_t *args, size_t cnt) {
+  return copy_from_user(args, (uint32_t *) f->esp + 1, cnt * sizeof *args);
 }
 
-/* Makes sure that string p is valid, based on the same criteria above */
-static bool is_valid_str(char *p) {
-  if( p == NULL ) return false;
-  while(*p) {
-    if (!is_valid_addr(p))
-      return false;
-    p++;
+/* Copies the null-terminated string at user address USTR into a
+   new kernel page, which the caller must free with
+   palloc_free_page().  Returns a null pointer if USTR is bad or
+   the string does not fit, or if memory is short. */
+static char *copy_in_string(const char *ustr) {
+  char *kstr = palloc_get_page(0);
+  int len;
+
+  if(kstr == NULL) {
+    return NULL;
+  }
+  len = strncpy_from_user(kstr, ustr, PGSIZE);
+  if(len < 0 || len == PGSIZE) {
+    palloc_free_page(kstr);
+    return NULL;
   }
-  return true;
+  return kstr;
+}
+
+/* Reads up to SIZE bytes from FD, the keyboard if FD is 0, into
+   user buffer UBUF a page at a time, through a kernel page.
+   Stores the number of bytes read in *CNT.  Returns false if UBUF
+   is not writable user memory. */
+static bool read_to_user(int fd, uint8_t *ubuf, off_t size, int *cnt) {
+  uint8_t *kbuf = palloc_get_page(0);
+  bool ok = true;
+
+  *cnt = 0;
+  if(kbuf == NULL) {
+    return true;
+  }
+  while(*cnt < size) {
+    off_t chunk = size - *cnt < PGSIZE ? size - *cnt : PGSIZE;
+    off_t got;
+
+    if(!fd) { // keyboard input
+      for(got = 0; got < chunk; got++) {
+        kbuf[got] = input_getc();
+      }
+    } else {
+      got = file_read(thread_current()->fds[fd], kbuf, chunk);
+    }
+    if(!copy_to_user(ubuf + *cnt, kbuf, got)) {
+      ok = false;
+      break;
+    }
+    *cnt += got;
+    if(got < chunk) {
+      break;
+    }
+  }
+  palloc_free_page(kbuf);
+  return ok;
+}
+
+/* Writes SIZE bytes from user buffer UBUF to FD, the console if
+   FD is 1, a page at a time, through a kernel page.  Stores the
+   number of bytes written in *CNT.  Returns false if UBUF is not
+   readable user memory. */
+static bool write_from_user(int fd, const uint8_t *ubuf, off_t size,
+                            int *cnt) {
+  uint8_t *kbuf = palloc_get_page(0);
+  bool ok = true;
+
+  *cnt = 0;
+  if(kbuf == NULL) {
+    return true;
+  }
+  while(*cnt < size) {
+    off_t chunk = size - *cnt < PGSIZE ? size - *cnt : PGSIZE;
+    off_t put;
+
+    if(!copy_from_user(kbuf, ubuf + *cnt, chunk)) {
+      ok = false;
+      break;
+    }
+    if(fd == 1) { // write to the console; must write all of the text from buffer
+      putbuf((char *) kbuf, chunk);
+      put = chunk;
+    } else {
+      put = file_write(thread_current()->fds[fd], kbuf, chunk);
+    }
+    *cnt += put;
+    if(put < chunk) {
+      break;
+    }
+  }
+  palloc_free_page(kbuf);
+  return ok;
 }
 
 /* Fetches the syscall number from f's stack pointer, as well as other arguments above it for certain sys calls, then executes the correct system call.  Exits if any bad pointers are accessed*/
@@ -46,13 +133,13 @@ syscall_handler (struct intr_frame *f)
 {
   int sys_num;
   int status = -1;
+  uint32_t args[3];
   struct thread* t = thread_current();
 
 //  printf("handling esp: %p\n",f->esp);
-  if(!is_valid_addr(f->esp)) {
+  t->user_esp = f->esp;
+  if(!copy_from_user(&sys_num, f->esp, sizeof sys_num)) {
     goto exit;
-  } else {
-    sys_num = *(int*)(f->esp);
   }
 
   switch (sys_num) {
@@ -62,14 +149,15 @@ syscall_handler (struct intr_frame *f)
       break;
     }
     case SYS_EXEC: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        char *cmd_line = *(char**)(f->esp+4);
-        if(!is_valid_str(cmd_line)) {
+        char *cmd_line = copy_in_string((const char *) args[0]);
+        if(cmd_line == NULL) {
           goto exit;
         }
         tid_t t = process_execute(cmd_line);
+        palloc_free_page(cmd_line);
         struct thread *thread = thread_get_by_id(t);
         if (thread == NULL) {
           f->eax = -1;
@@ -85,25 +173,26 @@ syscall_handler (struct intr_frame *f)
       }
     }
     case SYS_WAIT: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        int pid = *(int*)(f->esp+4);
+        int pid = args[0];
         int ret = process_wait(pid);
         f->eax = ret;
         break;
       }
     }
     case SYS_CREATE: {
-      if(!is_valid_addr(f->esp+4) || !is_valid_addr(f->esp+8)) {
+      if(!get_args(f, args, 2)) {
         goto exit;
       } else {
-        char *file = *(char**)(f->esp+4);
-        unsigned size = *(unsigned*)(f->esp+8);
-        if(!is_valid_str(file)) {
+        char *file = copy_in_string((const char *) args[0]);
+        unsigned size = args[1];
+        if(file == NULL) {
           goto exit;
         }
         bool created = filesys_create(file, size);
+        palloc_free_page(file);
         if(created)
           f->eax = 1;
         else
@@ -112,14 +201,15 @@ syscall_handler (struct intr_frame *f)
       }
     } 
     case SYS_REMOVE: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        char *file = *(char**)(f->esp+4);
-        if(!is_valid_str(file)) {
+        char *file = copy_in_string((const char *) args[0]);
+        if(file == NULL) {
           goto exit;
         }
         bool removed = filesys_remove(file);
+        palloc_free_page(file);
         if(removed)
           f->eax = 1;
         else
@@ -128,15 +218,16 @@ syscall_handler (struct intr_frame *f)
       }
     }
     case SYS_OPEN: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        char *filename = *(char**)(f->esp+4);
-        if(!is_valid_str(filename)) {
+        char *filename = copy_in_string((const char *) args[0]);
+        if(filename == NULL) {
           goto exit;
         }
         int fd = get_next_fd();
         struct file *file = filesys_open(filename);
+        palloc_free_page(filename);
         if (file == NULL)
            f->eax = -1;
         else {
@@ -147,10 +238,10 @@ syscall_handler (struct intr_frame *f)
       }
     }
     case SYS_FILESIZE: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
+        int fd = args[0];
         if(t->fds[fd] == NULL) {
           goto exit;
         }
@@ -159,61 +250,47 @@ syscall_handler (struct intr_frame *f)
       }
     } 
     case SYS_READ: {
-      if(!is_valid_addr(f->esp+4) || !is_valid_addr(f->esp+8) || !is_valid_addr(f->esp+12)) {
+      if(!get_args(f, args, 3)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
-        char *buffer = *(char**)(f->esp+8);
-        off_t size = *(int*)(f->esp+12);
-        if(!is_valid_addr(buffer)) {
+        int fd = args[0];
+        uint8_t *buffer = (uint8_t *) args[1];
+        off_t size = args[2];
+        int cnt;
+        if(fd && t->fds[fd] == NULL) {
           goto exit;
         }
-        if(!fd) { // keyboard input
-          int x;
-          for (x=0; x<size; x++) {
-            buffer[x] = input_getc();
-          }
-          f->eax = size;
-        } else {
-          if(t->fds[fd] == NULL) {
-            goto exit;
-          }
-          f->eax = (int)file_read(t->fds[fd], (void*)buffer, size);
+        if(!read_to_user(fd, buffer, size, &cnt)) {
+          goto exit;
         }
+        f->eax = cnt;
         break;
       }
     }
     case SYS_WRITE: {
-      if(!is_valid_addr(f->esp+4) || !is_valid_addr(f->esp+8) || !is_valid_addr(f->esp+12)) {
+      if(!get_args(f, args, 3)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
-        char *buffer = *(char**)(f->esp+8);
-        off_t size = *(int*)(f->esp+12);
-        int i;
-        for(i = 0; i < size; i++) {
-          if(!is_valid_addr(buffer+i)) {
-            goto exit;
-          }
+        int fd = args[0];
+        const uint8_t *buffer = (const uint8_t *) args[1];
+        off_t size = args[2];
+        int cnt;
+        if(fd != 1 && t->fds[fd] == NULL) {
+          goto exit;
         }
-        if(fd == 1) { // write to the console; must write all of the text from buffer
-          putbuf(buffer, size);
-          f->eax = size;
-        } else {
-           if(t->fds[fd] == NULL) {
-              goto exit;
-            }
-           f->eax = (int)file_write(t->fds[fd], buffer, size);
+        if(!write_from_user(fd, buffer, size, &cnt)) {
+          goto exit;
         }
+        f->eax = cnt;
         break;
       }
     }
     case SYS_SEEK: {
-      if(!is_valid_addr(f->esp+4) || !is_valid_addr(f->esp+8)) {
+      if(!get_args(f, args, 2)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
-        off_t size = *(int*)(f->esp+8);
+        int fd = args[0];
+        off_t size = args[1];
         if(t->fds[fd] == NULL) {
           goto exit;
         }
@@ -222,10 +299,10 @@ syscall_handler (struct intr_frame *f)
       }
     }
     case SYS_TELL: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
+        int fd = args[0];
         if(t->fds[fd] == NULL) {
           goto exit;
         }
@@ -234,10 +311,10 @@ syscall_handler (struct intr_frame *f)
       }
     }
     case SYS_CLOSE: {
-      if(!is_valid_addr(f->esp+4)) {
+      if(!get_args(f, args, 1)) {
         goto exit;
       } else {
-        int fd = *(int*)(f->esp+4);
+        int fd = args[0];
         if(t->fds[fd] == NULL) {
           goto exit;
         }
@@ -246,9 +323,78 @@ syscall_handler (struct intr_frame *f)
         break;
       }
     }
+    case SYS_MMAP: {
+      if(!get_args(f, args, 2)) {
+        goto exit;
+      } else {
+        int fd = args[0];
+        void *addr = (void *) args[1];
+        if(fd < 2 || fd >= 16 || t->fds[fd] == NULL) {
+          f->eax = MAP_FAILED;
+        } else {
+          f->eax = mmap_map(t->fds[fd], addr);
+        }
+        break;
+      }
+    }
+    case SYS_MUNMAP: {
+      if(!get_args(f, args, 1)) {
+        goto exit;
+      } else {
+        int mapid = args[0];
+        mmap_unmap(mapid);
+        break;
+      }
+    }
+    case SYS_MEMSTAT: {
+      if(!get_args(f, args, 1)) {
+        goto exit;
+      } else {
+        struct memstat *stats = malloc(sizeof *stats);
+        bool copied;
+        if(stats == NULL) {
+          f->eax = 0;
+          break;
+        }
+        palloc_get_stats(stats);
+        malloc_get_stats(stats);
+        exception_get_stats(stats);
+        copied = copy_to_user((struct memstat *) args[0], stats,
+                              sizeof *stats);
+        free(stats);
+        if(!copied) {
+          goto exit;
+        }
+        f->eax = 1;
+        break;
+      }
+    }
+    case SYS_FORK: {
+      f->eax = process_fork(f);
+      break;
+    }
+    case SYS_SETRSS: {
+      if(!get_args(f, args, 2)) {
+        goto exit;
+      } else {
+        size_t soft = args[0];
+        size_t hard = args[1];
+        f->eax = evict_set_rss_limits(soft, hard);
+        break;
+      }
+    }
+    case SYS_STACKLIMIT: {
+      if(!get_args(f, args, 1)) {
+        goto exit;
+      } else {
+        size_t pages = args[0];
+        f->eax = vma_set_stack_limit(pages);
+        break;
+      }
+    }
     case SYS_EXIT: {
-      if(is_valid_addr(f->esp+4)) {
-        status = *(int*)(f->esp + 4);
+      if(get_args(f, args, 1)) {
+        status = args[0];
       }
     }
     default:
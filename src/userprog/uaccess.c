@@ -0,0 +1,152 @@
+#include "userprog/uaccess.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/vaddr.h"
+
+/* Access to user memory from the kernel.
+
+   The kernel reads system call arguments and buffers straight
+   out of the calling process's address space, so any of those
+   accesses may fault: on a page that is merely not resident,
+   which page_fault() brings in as usual, or on an address the
+   process has no business passing, which page_fault() cannot
+   resolve.  Instead of checking every byte of a buffer before
+   touching it, the routines below check only that the buffer
+   lies below PHYS_BASE and then just copy it.  Each instruction
+   that touches user memory has an entry in the exception table,
+   which tells page_fault() where to resume when a fault on it
+   cannot be resolved.  The resume point makes the routine
+   report failure to its caller.
+
+   The table is built by the assembler and linker: each access
+   emits an (instruction, fixup) pair of addresses into section
+   __ex_table, which threads/kernel.lds.S gathers between
+   _start_ex_table and _end_ex_table. */
+
+/* An exception table entry. */
+struct ex_entry
+  {
+    uintptr_t insn;             /* Address of faulting instruction. */
+    uintptr_t fixup;            /* Address to resume at. */
+  };
+
+extern const struct ex_entry _start_ex_table[], _end_ex_table[];
+
+static bool user_range_ok (const void *uaddr, size_t size);
+static size_t raw_copy (void *dst, const void *src, size_t size);
+static bool get_user (char *dst, const char *usrc);
+
+/* Copies SIZE bytes from user address USRC to kernel address
+   DST.  Returns true if successful, false if any of the bytes is
+   not accessible user memory, in which case DST's contents are
+   undefined. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return user_range_ok (usrc, size) && raw_copy (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel address SRC to user address
+   UDST.  Returns true if successful, false if any of the bytes
+   is not writable user memory, in which case some of them may
+   have been written. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return user_range_ok (udst, size) && raw_copy (udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes.  Returns the length of the
+   string, not counting the null terminator, if it fits; SIZE if
+   it does not, in which case DST is not null-terminated; or -1
+   if the string is not accessible user memory. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t i;
+
+  if (usrc == NULL)
+    return -1;
+  for (i = 0; i < size; i++)
+    {
+      /* Check each page once, when the string enters it. */
+      if ((i == 0 || pg_ofs (usrc + i) == 0) && !is_user_vaddr (usrc + i))
+        return -1;
+      if (!get_user (&dst[i], usrc + i))
+        return -1;
+      if (dst[i] == '\0')
+        return i;
+    }
+  return size;
+}
+
+/* Called by page_fault() for a fault by the kernel that it could
+   not resolve.  If the faulting instruction in F has an entry in
+   the exception table, makes F resume at its fixup and returns
+   true.  Otherwise returns false. */
+bool
+uaccess_fixup (struct intr_frame *f)
+{
+  const struct ex_entry *e;
+
+  for (e = _start_ex_table; e < _end_ex_table; e++)
+    if (e->insn == (uintptr_t) f->eip)
+      {
+        f->eip = (void (*) (void)) e->fixup;
+        return true;
+      }
+  return false;
+}
+
+/* Returns true if the SIZE bytes starting at UADDR are all user
+   virtual addresses.  A null UADDR is rejected outright. */
+static bool
+user_range_ok (const void *uaddr, size_t size)
+{
+  const uint8_t *start = uaddr;
+
+  return (start != NULL && is_user_vaddr (start)
+          && size <= (size_t) ((uint8_t *) PHYS_BASE - start));
+}
+
+/* Copies SIZE bytes from SRC to DST, either of which may be in
+   user memory.  Returns the number of bytes left uncopied after
+   a fault that page_fault() could not resolve, or 0 if the copy
+   succeeded.
+
+   "rep movsb" leaves ECX counting the bytes not yet moved when
+   it faults, so the fixup is simply to carry on after it. */
+static size_t
+raw_copy (void *dst, const void *src, size_t size)
+{
+  asm volatile ("1: rep movsb\n"
+                "2:\n"
+                ".pushsection __ex_table, \"a\"\n"
+                "  .long 1b, 2b\n"
+                ".popsection"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
+  return size;
+}
+
+/* Reads the byte at user address USRC into *DST.  Returns true
+   if successful, false if USRC is not accessible user memory. */
+static bool
+get_user (char *dst, const char *usrc)
+{
+  int ok;
+
+  asm volatile ("movl $1, %0\n"
+                "1: movb %2, %b1\n"
+                "2:\n"
+                ".pushsection .fixup, \"ax\"\n"
+                "3: movl $0, %0\n"
+                "   jmp 2b\n"
+                ".popsection\n"
+                ".pushsection __ex_table, \"a\"\n"
+                "  .long 1b, 3b\n"
+                ".popsection"
+                : "=&r" (ok), "=q" (*dst) : "m" (*usrc));
+  return ok;
+}
@@ -0,0 +1,181 @@
+#include "vm/cleaner.h"
+#include <debug.h>
+#include <memstat.h>
+#include <stdbool.h>
+#include "threads/kmap.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+#include "vm/evict.h"
+#include "vm/swap.h"
+
+/* Background page cleaner.
+
+   Evicting a dirty page means writing it to swap before its
+   frame can be reused, on the critical path of whichever thread
+   happened to fault.  The cleaner is a kernel thread that tries
+   to make sure that by the time the clock hand reaches a page,
+   the page is clean.
+
+   It is woken whenever a frame is allocated while fewer than
+   the low watermark of frames are free.  It then looks at the
+   frames just ahead of the clock hand for pages that have not
+   been accessed since the hand last passed, which are the next
+   likely victims.  If not enough of those are clean already, it
+   clears the dirty bits of the dirty ones and writes them to
+   swap together, in consecutive slots.  A page written to while
+   this is in progress has its dirty bit set again and will be
+   written again.  This repeats until the frames ahead of the
+   hand hold enough clean pages or there is nothing to write.
+
+   The frames being written are pinned and their pages marked in
+   flight, so that frame_lock can be released during the write
+   without the pages being evicted or freed under the cleaner. */
+
+/* Frames ahead of the clock hand examined by each pass. */
+#define CLEANER_SCAN 64
+
+/* Most pages written per batch, and the number of clean idle
+   pages ahead of the hand that the cleaner aims for. */
+#define CLEANER_BATCH SWAP_CLUSTER_MAX
+
+/* Signaled to wake the cleaner, with frame_lock. */
+static struct condition wake_cond;
+static bool started;
+
+/* Statistics, protected by frame_lock. */
+static unsigned long long clean_cnt;    /* Pages written. */
+static unsigned long long batch_cnt;    /* Batches written. */
+
+static thread_func cleaner_thread NO_RETURN;
+static bool low_on_frames (void);
+static bool clean_batch (void);
+
+/* Starts the page cleaner thread. */
+void
+cleaner_init (void)
+{
+  cond_init (&wake_cond);
+  started = true;
+  thread_create ("cleaner", PRI_DEFAULT - 1, cleaner_thread, NULL);
+}
+
+/* Wakes the cleaner if free frames are running low.  Must be
+   called with frame_lock held. */
+void
+cleaner_wake (void)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (started && low_on_frames ())
+    cond_signal (&wake_cond, &frame_lock);
+}
+
+/* Fills in the cleaner fields of STATS. */
+void
+cleaner_get_stats (struct memstat *stats)
+{
+  stats->clean_cnt = clean_cnt;
+  stats->clean_batch_cnt = batch_cnt;
+}
+
+/* The cleaner thread.  Runs at slightly below default priority,
+   so that it mostly runs while user processes wait for the
+   disk. */
+static void
+cleaner_thread (void *aux UNUSED)
+{
+  lock_acquire (&frame_lock);
+  for (;;)
+    {
+      cond_wait (&wake_cond, &frame_lock);
+      while (low_on_frames () && clean_batch ())
+        {
+          /* Let faulting threads at the frame table between
+             batches. */
+          lock_release (&frame_lock);
+          thread_yield ();
+          lock_acquire (&frame_lock);
+        }
+    }
+}
+
+/* Returns true if fewer frames are free than the low
+   watermark, 1/16 of all frames. */
+static bool
+low_on_frames (void)
+{
+  return frame_free_count () < frame_count () / 16 + 1;
+}
+
+/* Writes out up to CLEANER_BATCH dirty, idle pages among the
+   CLEANER_SCAN frames ahead of the clock hand, unless there are
+   already CLEANER_BATCH clean idle pages there.  Returns true if
+   any page was written. */
+static bool
+clean_batch (void)
+{
+  struct page *pages[CLEANER_BATCH];
+  uintptr_t paddrs[CLEANER_BATCH];
+  void *kpages[CLEANER_BATCH];
+  size_t frames[CLEANER_BATCH];
+  size_t frame_cnt = frame_count ();
+  size_t hand = evict_hand ();
+  size_t dirty_cnt = 0;
+  size_t clean_idle_cnt = 0;
+  size_t n, i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (n = 0; n < CLEANER_SCAN && n < frame_cnt; n++)
+    {
+      size_t idx = (hand + n) % frame_cnt;
+      struct page *p = frame_page (idx);
+
+      if (p == NULL || pagedir_is_accessed (p->owner->pagedir, p->upage))
+        continue;
+      if (!page_is_dirty (p))
+        {
+          if (++clean_idle_cnt >= CLEANER_BATCH)
+            return false;
+        }
+      else if (dirty_cnt < CLEANER_BATCH)
+        {
+          pages[dirty_cnt] = p;
+          frames[dirty_cnt] = idx;
+          dirty_cnt++;
+        }
+    }
+  if (dirty_cnt == 0)
+    return false;
+
+  /* Clear the dirty bits first, so that writes made while the
+     pages are on their way to disk are not lost. */
+  for (i = 0; i < dirty_cnt; i++)
+    {
+      pagedir_set_dirty (pages[i]->owner->pagedir, pages[i]->upage, false);
+      frame_pin (frames[i]);
+      pages[i]->in_flight = true;
+      paddrs[i] = frame_to_phys (frames[i]);
+    }
+
+  /* The frames are pinned, so they can be mapped and written
+     without frame_lock, and must be, since kmap() slots may not
+     be held while waiting for it. */
+  lock_release (&frame_lock);
+  kmap_multiple (paddrs, kpages, dirty_cnt);
+  write_pages_back (pages, (const void **) kpages, dirty_cnt);
+  for (i = 0; i < dirty_cnt; i++)
+    kunmap (kpages[i]);
+  lock_acquire (&frame_lock);
+  for (i = 0; i < dirty_cnt; i++)
+    {
+      frame_unpin (frames[i]);
+      page_io_done (pages[i]);
+    }
+
+  clean_cnt += dirty_cnt;
+  batch_cnt++;
+  return true;
+}
@@ -0,0 +1,10 @@
+#ifndef VM_CLEANER_H
+#define VM_CLEANER_H
+
+struct memstat;
+
+void cleaner_init (void);
+void cleaner_wake (void);
+void cleaner_get_stats (struct memstat *);
+
+#endif /* vm/cleaner.h */
@@ -0,0 +1,423 @@
+#include "vm/evict.h"
+#include <debug.h>
+#include <memstat.h>
+#include <stdint.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/pagedir.h"
+
+/* Page replacement policies.
+
+   Both policies below sweep a "hand" around the frame table and
+   use the accessed bit in each page's PTE to tell recently used
+   pages from idle ones, clearing the bit as the hand passes so
+   that a page has to be touched again to survive the next
+   sweep.  Both prefer clean victims, since evicting a dirty page
+   costs a swap write.
+
+   The policy in use is chosen with the "-evict=NAME" kernel
+   command line option and defaults to "clock".
+
+   Whatever the policy, it first looks only at frames whose
+   pages all belong to processes over their allocation, so that
+   a process streaming through a huge array pays for its own
+   page faults instead of evicting everybody else's working set.
+   Only if there are none does it look at every frame.
+
+   A process's allocation is the number of resident pages it is
+   entitled to while memory is short.  It moves with the
+   process's page fault frequency: a process faulting more often
+   than once every PFF_INTERVAL ticks is short of memory and has
+   its allocation raised by PFF_STEP pages; a process that has
+   been faulting less often gives up PFF_STEP pages for each
+   PFF_INTERVAL since its last fault.  The allocation never
+   drops below the process's soft limit, so a process that must
+   stay resident can protect its working set by raising its soft
+   limit, and never rises above its hard limit.  A process at
+   its hard limit takes the frame for each new page from its own
+   pages, whether or not memory is short.  Both limits are set
+   with the setrss system call and inherited by child
+   processes. */
+
+/* WSClock working-set window, in timer ticks.  A page that has
+   not been accessed for longer than this is no longer in its
+   process's working set. */
+#define WSCLOCK_TAU (TIMER_FREQ / 4)
+
+/* Page fault frequency control.  See above. */
+#define PFF_INTERVAL (TIMER_FREQ / 10)
+#define PFF_STEP 8
+
+static size_t clock_select (struct frame *, size_t frame_cnt);
+static size_t wsclock_select (struct frame *, size_t frame_cnt);
+static bool evictable (struct frame *);
+static bool test_and_clear_accessed (struct frame *);
+static bool frame_is_dirty (struct frame *);
+
+static const struct evict_policy clock_policy = {"clock", clock_select};
+static const struct evict_policy wsclock_policy = {"wsclock", wsclock_select};
+
+/* All policies, terminated by a null pointer. */
+static const struct evict_policy *policies[] =
+  {
+    &clock_policy,
+    &wsclock_policy,
+    NULL
+  };
+
+/* The policy in use. */
+static const struct evict_policy *policy = &clock_policy;
+
+/* Index of the next frame the policy will look at. */
+static size_t hand;
+
+/* Frames the policy may pick, besides being evictable(). */
+static enum
+  {
+    ANY_FRAME,                  /* Any frame. */
+    OVER_FRAME,                 /* Only frames of sets over allocation. */
+    OWN_FRAME                   /* Only frames holding a page of OWNER. */
+  }
+filter;
+static const struct thread *owner;
+
+/* Statistics. */
+static unsigned long long over_cnt;     /* Victims over allocation. */
+static unsigned long long hard_cnt;     /* Victims at hard limits. */
+
+static size_t select_victim (struct frame *, size_t frame_cnt);
+static bool over_allocation (struct frame *);
+
+/* Selects the policy named NAME.  Returns true if successful,
+   false if there is no such policy. */
+bool
+evict_set_policy (const char *name)
+{
+  const struct evict_policy **p;
+
+  for (p = policies; *p != NULL; p++)
+    if (!strcmp ((*p)->name, name))
+      {
+        policy = *p;
+        return true;
+      }
+  return false;
+}
+
+/* Returns the name of the policy in use. */
+const char *
+evict_policy_name (void)
+{
+  return policy->name;
+}
+
+/* Returns the index of the next frame the policy will consider
+   for eviction. */
+size_t
+evict_hand (void)
+{
+  return hand;
+}
+
+/* Returns the index of the frame in FRAMES[] whose page should be
+   evicted next.  Panics if no frame holds an evictable page. */
+size_t
+evict_select_victim (struct frame *frames, size_t frame_cnt)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  filter = OVER_FRAME;
+  i = select_victim (frames, frame_cnt);
+  if (i != SIZE_MAX)
+    {
+      ASSERT (i < frame_cnt && evictable (&frames[i]));
+      filter = ANY_FRAME;
+      over_cnt++;
+      return i;
+    }
+
+  filter = ANY_FRAME;
+  i = select_victim (frames, frame_cnt);
+  if (i != SIZE_MAX)
+    {
+      ASSERT (i < frame_cnt && evictable (&frames[i]));
+      return i;
+    }
+
+  /* The policy came up empty, perhaps because every page was
+     touched again while it was looking.  Take any page. */
+  for (i = 0; i < frame_cnt; i++)
+    if (evictable (&frames[i]))
+      return i;
+  PANIC ("no evictable frames");
+}
+
+/* Returns the index of the frame in FRAMES[] holding a page of
+   process T that should be evicted next, or SIZE_MAX if none of
+   T's pages may be evicted.  Used when T is at its hard limit. */
+size_t
+evict_select_own (struct frame *frames, size_t frame_cnt,
+                  const struct thread *t)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  filter = OWN_FRAME;
+  owner = t;
+  i = select_victim (frames, frame_cnt);
+  filter = ANY_FRAME;
+  owner = NULL;
+  if (i != SIZE_MAX)
+    {
+      ASSERT (i < frame_cnt && evictable (&frames[i]));
+      hard_cnt++;
+    }
+  return i;
+}
+
+/* Fills in the eviction fields of STATS that are kept here, and
+   the running process's resident set size. */
+void
+evict_get_stats (struct memstat *stats)
+{
+  stats->evict_over_cnt = over_cnt;
+  stats->evict_hard_cnt = hard_cnt;
+  stats->rss_cnt = thread_current ()->rss;
+}
+
+/* Sets the running process's soft and hard resident set limits
+   to SOFT and HARD pages.  Returns false, changing nothing, if
+   SOFT exceeds HARD or HARD is 0. */
+bool
+evict_set_rss_limits (size_t soft, size_t hard)
+{
+  struct thread *t = thread_current ();
+
+  if (soft > hard || hard == 0)
+    return false;
+
+  lock_acquire (&frame_lock);
+  t->rss_soft = soft;
+  t->rss_hard = hard;
+  if (t->rss_alloc < soft)
+    t->rss_alloc = soft;
+  else if (t->rss_alloc > hard)
+    t->rss_alloc = hard;
+  lock_release (&frame_lock);
+  return true;
+}
+
+/* Adjusts the running process's allocation for a page fault that
+   it is about to take, according to the time since its last
+   one. */
+void
+evict_page_fault (void)
+{
+  struct thread *t = thread_current ();
+  int64_t now = timer_ticks ();
+  int64_t interval = now - t->last_fault;
+
+  lock_acquire (&frame_lock);
+  t->last_fault = now;
+  if (interval <= PFF_INTERVAL)
+    {
+      /* Faulting often: grow, up to the hard limit.  There is no
+         point in growing far beyond the pages actually held. */
+      if (t->rss_alloc < t->rss + PFF_STEP)
+        t->rss_alloc = (t->rss_hard - t->rss_alloc > PFF_STEP
+                        ? t->rss_alloc + PFF_STEP : t->rss_hard);
+    }
+  else
+    {
+      /* Faulting rarely: shrink, down to the soft limit. */
+      int64_t shrink = interval / PFF_INTERVAL * PFF_STEP;
+
+      if ((int64_t) (t->rss_alloc - t->rss_soft) > shrink)
+        t->rss_alloc -= shrink;
+      else
+        t->rss_alloc = t->rss_soft;
+    }
+  lock_release (&frame_lock);
+}
+
+/* Runs the policy's SELECT_VICTIM.  A sweep clears the accessed
+   bits of many pages, and touches no user memory, so their TLB
+   invalidations are batched. */
+static size_t
+select_victim (struct frame *frames, size_t frame_cnt)
+{
+  struct pagedir_batch batch;
+  size_t i;
+
+  pagedir_batch_begin (&batch);
+  i = policy->select_victim (frames, frame_cnt);
+  pagedir_batch_end (&batch);
+  return i;
+}
+
+/* Second-chance clock.  The hand clears the accessed bit of each
+   page it passes and stops at the first page whose bit was
+   already clear.  Dirty pages are passed over for up to two full
+   sweeps, in the hope of finding a clean page; after that the
+   first idle dirty page seen is taken. */
+static size_t
+clock_select (struct frame *frames, size_t frame_cnt)
+{
+  size_t dirty = SIZE_MAX;
+  size_t n;
+
+  for (n = 0; n < 2 * frame_cnt; n++)
+    {
+      size_t i = hand;
+      struct frame *f = &frames[i];
+
+      hand = (hand + 1) % frame_cnt;
+      if (!evictable (f) || test_and_clear_accessed (f))
+        continue;
+      if (!frame_is_dirty (f))
+        return i;
+      if (dirty == SIZE_MAX)
+        dirty = i;
+    }
+
+  if (dirty != SIZE_MAX)
+    hand = (dirty + 1) % frame_cnt;
+  return dirty;
+}
+
+/* WSClock.  As the hand passes a page whose accessed bit is set,
+   it clears the bit and stamps the frame with the current time.
+   A page whose bit is clear is evicted only if its stamp is more
+   than WSCLOCK_TAU ticks old, i.e. it has dropped out of its
+   process's working set, and it is clean.  If one sweep finds no
+   such page, the oldest dirty page outside the working set is
+   taken, then the oldest idle page of all, then any page. */
+static size_t
+wsclock_select (struct frame *frames, size_t frame_cnt)
+{
+  int64_t now = timer_ticks ();
+  size_t oldest = SIZE_MAX;
+  size_t oldest_dirty = SIZE_MAX;
+  size_t first = SIZE_MAX;
+  size_t n;
+
+  for (n = 0; n < frame_cnt; n++)
+    {
+      size_t i = hand;
+      struct frame *f = &frames[i];
+
+      hand = (hand + 1) % frame_cnt;
+      if (!evictable (f))
+        continue;
+      if (first == SIZE_MAX)
+        first = i;
+      if (test_and_clear_accessed (f))
+        {
+          f->last_used = now;
+          continue;
+        }
+
+      if (now - f->last_used > WSCLOCK_TAU)
+        {
+          if (!frame_is_dirty (f))
+            return i;
+          if (oldest_dirty == SIZE_MAX
+              || f->last_used < frames[oldest_dirty].last_used)
+            oldest_dirty = i;
+        }
+      if (oldest == SIZE_MAX || f->last_used < frames[oldest].last_used)
+        oldest = i;
+    }
+
+  if (oldest_dirty != SIZE_MAX)
+    return oldest_dirty;
+  else if (oldest != SIZE_MAX)
+    return oldest;
+  else
+    return first;
+}
+
+/* Returns true if frame F may be evicted: some page is mapped to
+   it, it is not pinned for I/O, and it passes FILTER. */
+static bool
+evictable (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->ref_cnt == 0 || f->pinned)
+    return false;
+  switch (filter)
+    {
+    case ANY_FRAME:
+      return true;
+    case OVER_FRAME:
+      return over_allocation (f);
+    case OWN_FRAME:
+      for (e = list_begin (&f->rmap); e != list_end (&f->rmap);
+           e = list_next (e))
+        if (list_entry (e, struct page, rmap_elem)->owner == owner)
+          return true;
+      return false;
+    }
+  NOT_REACHED ();
+}
+
+/* Returns true if every page mapped to frame F belongs to a
+   process holding more pages than its allocation. */
+static bool
+over_allocation (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->rmap); e != list_end (&f->rmap);
+       e = list_next (e))
+    {
+      const struct thread *t = list_entry (e, struct page, rmap_elem)->owner;
+      if (t->rss <= t->rss_alloc)
+        return false;
+    }
+  return true;
+}
+
+/* Returns true if any page mapped to frame F has been accessed
+   since the last call, and clears their accessed bits. */
+static bool
+test_and_clear_accessed (struct frame *f)
+{
+  bool accessed = false;
+  struct list_elem *e;
+
+  for (e = list_begin (&f->rmap); e != list_end (&f->rmap);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, rmap_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (!pagedir_is_accessed (pd, p->upage))
+        continue;
+      pagedir_set_accessed (pd, p->upage, false);
+      if (p->readahead)
+        page_readahead_done (p, true);
+      accessed = true;
+    }
+  return accessed;
+}
+
+/* Returns true if evicting frame F would require writing it
+   out. */
+static bool
+frame_is_dirty (struct frame *f)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&f->rmap); e != list_end (&f->rmap);
+       e = list_next (e))
+    if (page_is_dirty (list_entry (e, struct page, rmap_elem)))
+      return true;
+  return false;
+}
@@ -0,0 +1,39 @@
+#ifndef VM_EVICT_H
+#define VM_EVICT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+
+struct memstat;
+struct thread;
+
+/* A resident set limit of "no limit". */
+#define RSS_UNLIMITED SIZE_MAX
+
+/* A page replacement policy.
+
+   SELECT_VICTIM is called with frame_lock held when a frame is
+   needed and none is free.  It must return the index of a frame
+   in FRAMES[] that may be evicted (one that some page is mapped
+   to and that is not pinned), or SIZE_MAX if it could not find
+   one. */
+struct evict_policy
+  {
+    const char *name;                   /* Name for "-evict=NAME". */
+    size_t (*select_victim) (struct frame *frames, size_t frame_cnt);
+  };
+
+bool evict_set_policy (const char *name);
+const char *evict_policy_name (void);
+size_t evict_hand (void);
+size_t evict_select_victim (struct frame *frames, size_t frame_cnt);
+size_t evict_select_own (struct frame *frames, size_t frame_cnt,
+                         const struct thread *);
+void evict_get_stats (struct memstat *);
+
+bool evict_set_rss_limits (size_t soft, size_t hard);
+void evict_page_fault (void);
+
+#endif /* vm/evict.h */
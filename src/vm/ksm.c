@@ -0,0 +1,175 @@
+#include "vm/ksm.h"
+#include <debug.h>
+#include <hash.h>
+#include <memstat.h>
+#include <round.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/kmap.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Same-page merging.
+
+   Processes running the same program often hold anonymous pages
+   with the same contents: tables built the same way, buffers
+   filled with the same data.  The merger is an optional kernel
+   thread that walks the frame table at a limited rate, hashing
+   the contents of frames that frame_is_mergeable(), and merges
+   frames with the same contents into one frame shared
+   copy-on-write, using frame_merge().
+
+   A frame is only a candidate once its hash has not changed
+   since the last pass, so that pages still being written are
+   left alone.  Candidates are kept in a table by hash, which is
+   emptied at the start of each pass so that it never refers to
+   frames that have long since been reused.  An entry may still
+   be stale, but frame_merge() compares the frames' contents, so
+   that is harmless.
+
+   Merged frames stay in the table, so more copies can be merged
+   into them.  Writes to a merged page fault into page_unshare(),
+   which copies it out again ("unmerges" it). */
+
+/* Time between batches of frames, in milliseconds. */
+#define KSM_PERIOD 100
+
+/* A candidate frame. */
+struct ksm_entry
+  {
+    struct hash_elem elem;      /* Element in candidates. */
+    unsigned sum;               /* Hash of the frame's contents. */
+    size_t frame;               /* Frame index. */
+  };
+
+/* State of the merger thread, protected by frame_lock. */
+static unsigned *sums;          /* Each frame's hash at the last pass. */
+static struct hash candidates;  /* Candidate frames by hash. */
+static size_t cursor;           /* Next frame to scan. */
+static size_t batch_size;       /* Frames scanned per KSM_PERIOD. */
+static unsigned long long scan_cnt; /* Frames scanned. */
+
+static thread_func ksm_thread NO_RETURN;
+static void scan_frame (size_t);
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+static hash_action_func entry_free;
+
+/* Starts the merger thread, scanning SCAN_RATE frames per
+   second, unless SCAN_RATE is 0. */
+void
+ksm_init (unsigned scan_rate)
+{
+  if (scan_rate == 0)
+    return;
+
+  sums = calloc (frame_count (), sizeof *sums);
+  if (sums == NULL || !hash_init (&candidates, entry_hash, entry_less, NULL))
+    PANIC ("ksm: out of memory");
+  batch_size = DIV_ROUND_UP (scan_rate * KSM_PERIOD, 1000);
+  thread_create ("ksm", PRI_MIN, ksm_thread, NULL);
+}
+
+/* Fills in the page merging fields of STATS that are kept
+   here. */
+void
+ksm_get_stats (struct memstat *stats)
+{
+  stats->ksm_scan_cnt = scan_cnt;
+}
+
+/* Scans BATCH_SIZE frames every KSM_PERIOD milliseconds,
+   forever. */
+static void
+ksm_thread (void *aux UNUSED)
+{
+  size_t frame_cnt = frame_count ();
+
+  for (;;)
+    {
+      size_t i;
+
+      timer_msleep (KSM_PERIOD);
+      for (i = 0; i < batch_size && frame_cnt > 0; i++)
+        {
+          lock_acquire (&frame_lock);
+          if (cursor == 0)
+            hash_clear (&candidates, entry_free);
+          scan_frame (cursor);
+          cursor = (cursor + 1) % frame_cnt;
+          lock_release (&frame_lock);
+        }
+    }
+}
+
+/* Hashes frame IDX, if it may be merged, and merges it with a
+   candidate that has the same hash, or makes it a candidate
+   itself.  Must be called with frame_lock held. */
+static void
+scan_frame (size_t idx)
+{
+  struct ksm_entry key, *e;
+  struct hash_elem *found;
+  void *kpage;
+  unsigned sum;
+
+  if (!frame_is_mergeable (idx))
+    return;
+  kpage = frame_kmap (idx);
+  sum = hash_bytes (kpage, PGSIZE);
+  kunmap (kpage);
+  scan_cnt++;
+  if (sum != sums[idx])
+    {
+      /* Changed since the last pass, or never seen. */
+      sums[idx] = sum;
+      return;
+    }
+
+  key.sum = sum;
+  found = hash_find (&candidates, &key.elem);
+  if (found != NULL)
+    {
+      e = hash_entry (found, struct ksm_entry, elem);
+      if (e->frame == idx || frame_merge (e->frame, idx))
+        return;
+
+      /* The candidate is stale or just collided.  Replace it. */
+      e->frame = idx;
+      return;
+    }
+
+  e = malloc (sizeof *e);
+  if (e != NULL)
+    {
+      e->sum = sum;
+      e->frame = idx;
+      hash_insert (&candidates, &e->elem);
+    }
+}
+
+/* Returns a hash value for candidate E. */
+static unsigned
+entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  return hash_entry (e_, struct ksm_entry, elem)->sum;
+}
+
+/* Returns true if candidate A precedes candidate B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  return (hash_entry (a_, struct ksm_entry, elem)->sum
+          < hash_entry (b_, struct ksm_entry, elem)->sum);
+}
+
+/* Frees candidate E. */
+static void
+entry_free (struct hash_elem *e, void *aux UNUSED)
+{
+  free (hash_entry (e, struct ksm_entry, elem));
+}
@@ -0,0 +1,9 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+
+struct memstat;
+
+void ksm_init (unsigned scan_rate);
+void ksm_get_stats (struct memstat *);
+
+#endif /* vm/ksm.h */
@@ -0,0 +1,109 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "vm/vma.h"
+
+/* Memory-mapped files.
+
+   mmap_map() maps a whole file, page by page, at a page-aligned
+   user address, as a shared virtual memory area.  Nothing is
+   read at that point: restore_page() reads each page from the
+   file the first time it is touched.  The part of the last page
+   past the end of the file reads as zeros and is never written
+   back.
+
+   A mapped page is never written to swap.  When it is evicted or
+   unmapped, it is written back to the file if its dirty bit is
+   set and otherwise simply dropped, since the file still has its
+   contents. */
+
+static struct vma *find_mapping (int mapid);
+
+/* Maps FILE into the running process's address space starting
+   at ADDR, and returns the new mapping's identifier, or
+   MAP_FAILED if FILE is empty, ADDR is null or not page-aligned,
+   or the mapping would overlap another area or the region
+   reserved for the stack. */
+int
+mmap_map (struct file *file, void *addr)
+{
+  struct thread *t = thread_current ();
+  uint8_t *stack_bottom = vma_stack_reserve (t);
+  struct vma *vma;
+  off_t length;
+  size_t page_cnt;
+
+  if (addr == NULL || pg_ofs (addr) != 0 || (uint8_t *) addr >= stack_bottom)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length <= 0)
+    return MAP_FAILED;
+
+  page_cnt = DIV_ROUND_UP (length, PGSIZE);
+  if (page_cnt > (size_t) (stack_bottom - (uint8_t *) addr) / PGSIZE)
+    return MAP_FAILED;
+  vma = vma_create (addr, page_cnt, file, 0, length, true, VMA_SHARED);
+  if (vma == NULL)
+    return MAP_FAILED;
+  vma->id = t->next_mapid++;
+  return vma->id;
+}
+
+/* Unmaps the running process's mapping MAPID, writing its dirty
+   pages back to the file.  Does nothing if there is no such
+   mapping. */
+void
+mmap_unmap (int mapid)
+{
+  struct vma *vma;
+
+  lock_acquire (&frame_lock);
+  vma = find_mapping (mapid);
+  if (vma != NULL)
+    vma_unmap (vma);
+  lock_release (&frame_lock);
+}
+
+/* Unmaps all of the running process's mappings.  Called at
+   process exit, with frame_lock held. */
+void
+mmap_unmap_all (void)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas); )
+    {
+      struct vma *vma = list_entry (e, struct vma, elem);
+      e = list_next (e);
+      if (vma->type == VMA_SHARED)
+        vma_unmap (vma);
+    }
+}
+
+/* Returns the running process's mapping MAPID, or a null pointer
+   if there is none. */
+static struct vma *
+find_mapping (int mapid)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas);
+       e = list_next (e))
+    {
+      struct vma *vma = list_entry (e, struct vma, elem);
+      if (vma->type == VMA_SHARED && vma->id == mapid)
+        return vma;
+    }
+  return NULL;
+}
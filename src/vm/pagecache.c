@@ -0,0 +1,142 @@
+#include "vm/pagecache.h"
+#include <debug.h>
+#include <hash.h>
+#include <memstat.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Page cache of shared read-only file pages.
+
+   Every process running a given executable maps its text from
+   the same file at the same offsets.  Rather than have each of
+   them read its own copy, restore_page() looks read-only,
+   file-backed pages up here by inode and offset, and if some
+   process already has the page in a frame, maps that frame
+   instead, adding the page to the frame's reverse map.
+
+   A frame is in the cache exactly as long as some page is
+   mapped to it: it is removed when it is evicted or when the
+   last page mapped to it goes away.  While any process runs an
+   executable, writes to it are denied, so cached pages never go
+   stale.
+
+   The cache is protected by frame_lock. */
+
+/* A cached page. */
+struct cache_entry
+  {
+    struct hash_elem elem;      /* Element in cache. */
+    struct inode *inode;        /* File... */
+    off_t ofs;                  /* ...and offset in it. */
+    int frame_index;            /* Frame holding the page. */
+  };
+
+static struct hash cache;
+
+/* Statistics, protected by frame_lock. */
+static unsigned long long hit_cnt;      /* Lookups that found a frame. */
+
+static struct cache_entry *find_entry (struct inode *, off_t);
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Initializes the page cache. */
+void
+pagecache_init (void)
+{
+  hash_init (&cache, entry_hash, entry_less, NULL);
+}
+
+/* Returns the index of the frame holding the page at offset OFS
+   in INODE, or -1 if it is not cached.  Must be called with
+   frame_lock held. */
+int
+pagecache_lookup (struct inode *inode, off_t ofs)
+{
+  struct cache_entry *e = find_entry (inode, ofs);
+
+  if (e == NULL)
+    return -1;
+  hit_cnt++;
+  return e->frame_index;
+}
+
+/* Records that frame FRAME_INDEX holds the page at offset OFS in
+   INODE, which must not be cached already.  Returns true if
+   successful, false if memory could not be allocated.  Must be
+   called with frame_lock held. */
+bool
+pagecache_insert (struct inode *inode, off_t ofs, int frame_index)
+{
+  struct cache_entry *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    return false;
+  e->inode = inode;
+  e->ofs = ofs;
+  e->frame_index = frame_index;
+  if (hash_insert (&cache, &e->elem) != NULL)
+    PANIC ("page cached twice");
+  return true;
+}
+
+/* Removes the page at offset OFS in INODE, which must be cached,
+   from the cache.  Must be called with frame_lock held. */
+void
+pagecache_remove (struct inode *inode, off_t ofs)
+{
+  struct cache_entry *e = find_entry (inode, ofs);
+
+  ASSERT (e != NULL);
+  hash_delete (&cache, &e->elem);
+  free (e);
+}
+
+/* Fills in the page cache fields of STATS. */
+void
+pagecache_get_stats (struct memstat *stats)
+{
+  stats->pagecache_cnt = hash_size (&cache);
+  stats->pagecache_hit_cnt = hit_cnt;
+}
+
+/* Returns the cache entry for offset OFS in INODE, or a null
+   pointer if there is none. */
+static struct cache_entry *
+find_entry (struct inode *inode, off_t ofs)
+{
+  struct cache_entry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  key.inode = inode;
+  key.ofs = ofs;
+  e = hash_find (&cache, &key.elem);
+  return e != NULL ? hash_entry (e, struct cache_entry, elem) : NULL;
+}
+
+/* Returns a hash value for cache entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct cache_entry *e = hash_entry (e_, struct cache_entry, elem);
+  return hash_bytes (&e->inode, sizeof e->inode) ^ hash_int (e->ofs);
+}
+
+/* Returns true if cache entry A precedes cache entry B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct cache_entry *a = hash_entry (a_, struct cache_entry, elem);
+  const struct cache_entry *b = hash_entry (b_, struct cache_entry, elem);
+
+  if (a->inode != b->inode)
+    return a->inode < b->inode;
+  return a->ofs < b->ofs;
+}
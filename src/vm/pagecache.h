@@ -0,0 +1,16 @@
+#ifndef VM_PAGECACHE_H
+#define VM_PAGECACHE_H
+
+#include <stdbool.h>
+#include "filesys/off_t.h"
+
+struct inode;
+struct memstat;
+
+void pagecache_init (void);
+int pagecache_lookup (struct inode *, off_t ofs);
+bool pagecache_insert (struct inode *, off_t ofs, int frame_index);
+void pagecache_remove (struct inode *, off_t ofs);
+void pagecache_get_stats (struct memstat *);
+
+#endif /* vm/pagecache.h */
@@ -0,0 +1,127 @@
+#include "vm/spt.h"
+#include <debug.h>
+#include <stdint.h>
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Supplemental page table.
+
+   Looking a page up takes two array references, indexed by
+   pd_no() and pt_no() of its address, however many pages the
+   process has, and never has to stop to rehash.  Page tables are
+   kernel pages, allocated when the first page in their 4 MB of
+   address space is inserted and freed only when the whole table
+   is destroyed. */
+
+/* Number of page directory entries that cover user memory. */
+#define USER_PDE_CNT ((uintptr_t) PHYS_BASE >> PDSHIFT)
+
+/* Initializes SPT as an empty table.  Allocates nothing, so it
+   may be called before the page allocator is initialized. */
+void
+spt_init (struct spt *spt)
+{
+  spt->dir = NULL;
+  spt->page_cnt = 0;
+}
+
+/* Inserts P into SPT, which must not already have a page at
+   P's address.  Returns true if successful, false if memory
+   for a page table could not be allocated. */
+bool
+spt_insert (struct spt *spt, struct page *p)
+{
+  struct page **pt;
+
+  ASSERT (is_user_vaddr (p->upage));
+  ASSERT (pg_ofs (p->upage) == 0);
+  ASSERT (spt_find (spt, p->upage) == NULL);
+
+  if (spt->dir == NULL)
+    {
+      spt->dir = palloc_get_page (PAL_ZERO);
+      if (spt->dir == NULL)
+        return false;
+    }
+  pt = spt->dir[pd_no (p->upage)];
+  if (pt == NULL)
+    {
+      pt = spt->dir[pd_no (p->upage)] = palloc_get_page (PAL_ZERO);
+      if (pt == NULL)
+        return false;
+    }
+  pt[pt_no (p->upage)] = p;
+  spt->page_cnt++;
+  return true;
+}
+
+/* Returns the page in SPT at user virtual address UPAGE, which
+   need not be page-aligned, or a null pointer if there is
+   none. */
+struct page *
+spt_find (const struct spt *spt, const void *upage)
+{
+  struct page **pt;
+
+  if (spt->dir == NULL || !is_user_vaddr (upage))
+    return NULL;
+  pt = spt->dir[pd_no (upage)];
+  return pt != NULL ? pt[pt_no (upage)] : NULL;
+}
+
+/* Removes P, which must be in SPT, from SPT. */
+void
+spt_remove (struct spt *spt, struct page *p)
+{
+  ASSERT (spt_find (spt, p->upage) == p);
+
+  spt->dir[pd_no (p->upage)][pt_no (p->upage)] = NULL;
+  spt->page_cnt--;
+}
+
+/* Calls ACTION on each page in SPT, in order of address, until
+   it returns false.  Returns false if ACTION did, true
+   otherwise.  ACTION must not insert pages into SPT or remove
+   pages from it. */
+bool
+spt_for_each (struct spt *spt, spt_action_func *action, void *aux)
+{
+  size_t pde, pte;
+
+  if (spt->dir == NULL)
+    return true;
+  for (pde = 0; pde < USER_PDE_CNT; pde++)
+    {
+      struct page **pt = spt->dir[pde];
+      if (pt != NULL)
+        for (pte = 0; pte < PGSIZE / sizeof *pt; pte++)
+          if (pt[pte] != NULL && !action (pt[pte], aux))
+            return false;
+    }
+  return true;
+}
+
+/* Calls DESTRUCTOR on each page in SPT and frees SPT's page
+   tables, leaving SPT empty. */
+void
+spt_destroy (struct spt *spt, void (*destructor) (struct page *))
+{
+  size_t pde, pte;
+
+  if (spt->dir == NULL)
+    return;
+  for (pde = 0; pde < USER_PDE_CNT; pde++)
+    {
+      struct page **pt = spt->dir[pde];
+      if (pt != NULL)
+        {
+          for (pte = 0; pte < PGSIZE / sizeof *pt; pte++)
+            if (pt[pte] != NULL)
+              destructor (pt[pte]);
+          palloc_free_page (pt);
+        }
+    }
+  palloc_free_page (spt->dir);
+  spt_init (spt);
+}
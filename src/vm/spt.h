@@ -0,0 +1,30 @@
+#ifndef VM_SPT_H
+#define VM_SPT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct page;
+
+/* Supplemental page table: a process's struct pages, indexed by
+   user virtual page number.  Laid out like the x86 page
+   directory, as a directory of page tables that are allocated
+   only for the 4 MB regions that have any pages. */
+struct spt
+  {
+    struct page ***dir;         /* Page directory, or null if empty. */
+    size_t page_cnt;            /* Number of pages in the table. */
+  };
+
+/* Performs some operation on page P, given auxiliary data AUX.
+   Returns false to stop an iteration. */
+typedef bool spt_action_func (struct page *p, void *aux);
+
+void spt_init (struct spt *);
+bool spt_insert (struct spt *, struct page *);
+struct page *spt_find (const struct spt *, const void *upage);
+void spt_remove (struct spt *, struct page *);
+bool spt_for_each (struct spt *, spt_action_func *, void *aux);
+void spt_destroy (struct spt *, void (*destructor) (struct page *));
+
+#endif /* vm/spt.h */
@@ -0,0 +1,259 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <memstat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/zswap.h"
+
+/* Swap slot allocator.
+
+   The swap device is divided into page-sized "slots", each
+   SECTORS_PER_SLOT sectors long, and a bitmap with one bit per
+   slot records which are in use.  The number of slots comes from
+   the size of the swap device itself.
+
+   swap_alloc() can hand out several physically contiguous slots
+   at once, so that a batch of pages can be written with one
+   sequential sweep of the disk.  Searches start where the last
+   one left off (next fit), which keeps slots allocated close
+   together in time close together on disk as well.
+
+   Runs of slots are read and written with one vectored device
+   request each, so the disk sees a single multi-sector transfer
+   instead of one request per sector.
+
+   After fork(), parent and child pages can be backed by the same
+   slot.  Each slot has a reference count, raised by swap_dup(),
+   and swap_free() releases a slot only when its count drops to
+   zero.
+
+   Pages are offered to the compressed swap cache in vm/zswap.c
+   on their way to disk and looked for there on their way back,
+   so a slot's contents may be on disk or in the cache. */
+
+/* Sectors per page-sized slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static struct block *swap_block;        /* Swap device, or null. */
+static struct bitmap *used_map;         /* Slots in use. */
+static uint16_t *ref_cnts;              /* References to each slot. */
+static size_t next_slot;                /* Where to start searching. */
+static struct lock swap_lock;           /* Protects the above. */
+
+static void read_slots (size_t slot, void *pages[], size_t cnt);
+static void write_slots (size_t slot, const void *pages[], size_t cnt);
+
+/* Initializes the swap allocator from the device in the
+   BLOCK_SWAP role, if there is one.  Without a swap device,
+   every allocation fails. */
+void
+swap_init (void)
+{
+  size_t slot_cnt = 0;
+
+  swap_block = block_get_role (BLOCK_SWAP);
+  if (swap_block != NULL)
+    slot_cnt = block_size (swap_block) / SECTORS_PER_SLOT;
+
+  used_map = bitmap_create (slot_cnt);
+  ref_cnts = calloc (slot_cnt, sizeof *ref_cnts);
+  if (used_map == NULL || (slot_cnt > 0 && ref_cnts == NULL))
+    PANIC ("swap: slot map allocation failed");
+  next_slot = 0;
+  lock_init (&swap_lock);
+  if (swap_block != NULL)
+    printf ("swap: %zu slots on %s\n", slot_cnt, block_name (swap_block));
+}
+
+/* Allocates CNT contiguous swap slots and returns the first, or
+   SWAP_NONE if no run of CNT free slots exists. */
+size_t
+swap_alloc (size_t cnt)
+{
+  size_t slot;
+
+  ASSERT (cnt > 0);
+
+  lock_acquire (&swap_lock);
+  slot = bitmap_scan_and_flip (used_map, next_slot, cnt, false);
+  if (slot == BITMAP_ERROR && next_slot != 0)
+    slot = bitmap_scan_and_flip (used_map, 0, cnt, false);
+  if (slot != BITMAP_ERROR)
+    {
+      size_t i;
+
+      for (i = 0; i < cnt; i++)
+        ref_cnts[slot + i] = 1;
+      next_slot = slot + cnt < bitmap_size (used_map) ? slot + cnt : 0;
+    }
+  lock_release (&swap_lock);
+
+  return slot != BITMAP_ERROR ? slot : SWAP_NONE;
+}
+
+/* Adds a reference to swap slot SLOT, which must be in use, and
+   returns SLOT. */
+size_t
+swap_dup (size_t slot)
+{
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_test (used_map, slot));
+  ASSERT (ref_cnts[slot] < UINT16_MAX);
+  ref_cnts[slot]++;
+  lock_release (&swap_lock);
+  return slot;
+}
+
+/* Drops a reference to each of the CNT swap slots starting at
+   SLOT, freeing those that are no longer referenced. */
+void
+swap_free (size_t slot, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&swap_lock);
+  ASSERT (bitmap_all (used_map, slot, cnt));
+  for (i = slot; i < slot + cnt; i++)
+    if (--ref_cnts[i] == 0)
+      {
+        zswap_drop (i);
+        bitmap_reset (used_map, i);
+      }
+  lock_release (&swap_lock);
+}
+
+/* Reads swap slot SLOT into PAGE. */
+void
+swap_read (size_t slot, void *page)
+{
+  swap_read_pages (slot, &page, 1);
+}
+
+/* Writes PAGE to swap slot SLOT. */
+void
+swap_write (size_t slot, const void *page)
+{
+  swap_write_pages (slot, &page, 1);
+}
+
+/* Writes PAGE to swap slot SLOT on disk, bypassing the
+   compressed swap cache.  For the cache's own use. */
+void
+swap_write_disk (size_t slot, const void *page)
+{
+  write_slots (slot, &page, 1);
+}
+
+/* Reads the CNT slots starting at SLOT into PAGES[0], PAGES[1],
+   ..., taking those that are in the compressed swap cache from
+   there and reading each run of the others from disk with as
+   few requests as possible. */
+void
+swap_read_pages (size_t slot, void *pages[], size_t cnt)
+{
+  size_t i, run = 0;
+
+  ASSERT (slot + cnt <= bitmap_size (used_map));
+  for (i = 0; i < cnt; i++)
+    if (zswap_load (slot + i, pages[i]))
+      {
+        read_slots (slot + i - run, pages + i - run, run);
+        run = 0;
+      }
+    else
+      run++;
+  read_slots (slot + cnt - run, pages + cnt - run, run);
+}
+
+/* Writes PAGES[0], PAGES[1], ... to the CNT slots starting at
+   SLOT, putting those that compress well in the compressed swap
+   cache and writing each run of the others to disk with as few
+   requests as possible. */
+void
+swap_write_pages (size_t slot, const void *pages[], size_t cnt)
+{
+  size_t i, run = 0;
+
+  ASSERT (slot + cnt <= bitmap_size (used_map));
+  for (i = 0; i < cnt; i++)
+    if (zswap_store (slot + i, pages[i]))
+      {
+        write_slots (slot + i - run, pages + i - run, run);
+        run = 0;
+      }
+    else
+      run++;
+  write_slots (slot + cnt - run, pages + cnt - run, run);
+}
+
+/* Reads the CNT slots starting at SLOT from disk into PAGES[0],
+   PAGES[1], ..., issuing one device request per
+   SWAP_CLUSTER_MAX pages. */
+static void
+read_slots (size_t slot, void *pages[], size_t cnt)
+{
+  void *sectors[SWAP_CLUSTER_MAX * SECTORS_PER_SLOT];
+
+  ASSERT (slot + cnt <= bitmap_size (used_map));
+  while (cnt > 0)
+    {
+      size_t page_cnt = cnt < SWAP_CLUSTER_MAX ? cnt : SWAP_CLUSTER_MAX;
+      size_t i;
+
+      for (i = 0; i < page_cnt * SECTORS_PER_SLOT; i++)
+        sectors[i] = (uint8_t *) pages[i / SECTORS_PER_SLOT]
+                     + i % SECTORS_PER_SLOT * BLOCK_SECTOR_SIZE;
+      block_readv (swap_block, slot * SECTORS_PER_SLOT, sectors,
+                   page_cnt * SECTORS_PER_SLOT);
+
+      slot += page_cnt;
+      pages += page_cnt;
+      cnt -= page_cnt;
+    }
+}
+
+/* Writes PAGES[0], PAGES[1], ... to the CNT slots starting at
+   SLOT on disk, issuing one device request per SWAP_CLUSTER_MAX
+   pages. */
+static void
+write_slots (size_t slot, const void *pages[], size_t cnt)
+{
+  const void *sectors[SWAP_CLUSTER_MAX * SECTORS_PER_SLOT];
+
+  ASSERT (slot + cnt <= bitmap_size (used_map));
+  while (cnt > 0)
+    {
+      size_t page_cnt = cnt < SWAP_CLUSTER_MAX ? cnt : SWAP_CLUSTER_MAX;
+      size_t i;
+
+      for (i = 0; i < page_cnt * SECTORS_PER_SLOT; i++)
+        sectors[i] = (const uint8_t *) pages[i / SECTORS_PER_SLOT]
+                     + i % SECTORS_PER_SLOT * BLOCK_SECTOR_SIZE;
+      block_writev (swap_block, slot * SECTORS_PER_SLOT, sectors,
+                    page_cnt * SECTORS_PER_SLOT);
+
+      slot += page_cnt;
+      pages += page_cnt;
+      cnt -= page_cnt;
+    }
+}
+
+/* Fills in the swap fields of STATS.  No lock is taken, so this
+   is safe to call from any context. */
+void
+swap_get_stats (struct memstat *stats)
+{
+  if (used_map != NULL)
+    {
+      stats->swap_slot_cnt = bitmap_size (used_map);
+      stats->swap_used_cnt = bitmap_count (used_map, 0, stats->swap_slot_cnt,
+                                           true);
+    }
+  else
+    stats->swap_slot_cnt = stats->swap_used_cnt = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stddef.h>
+
+/* Swap slot number meaning "no slot". */
+#define SWAP_NONE ((size_t) -1)
+
+/* Swap read-ahead window limits, in pages, counting the page
+   that faulted.  A window of 1 means no read-ahead. */
+#define SWAP_RA_INIT 4          /* Window of a new process. */
+#define SWAP_RA_MAX 16          /* Largest window. */
+
+/* Most pages read or written by one swap request. */
+#define SWAP_CLUSTER_MAX SWAP_RA_MAX
+
+struct memstat;
+
+void swap_init (void);
+size_t swap_alloc (size_t cnt);
+size_t swap_dup (size_t slot);
+void swap_free (size_t slot, size_t cnt);
+void swap_read (size_t slot, void *page);
+void swap_write (size_t slot, const void *page);
+void swap_read_pages (size_t slot, void *pages[], size_t cnt);
+void swap_write_pages (size_t slot, const void *pages[], size_t cnt);
+void swap_write_disk (size_t slot, const void *page);
+void swap_get_stats (struct memstat *);
+
+#endif /* vm/swap.h */
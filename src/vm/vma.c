@@ -0,0 +1,424 @@
+#include "vm/vma.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/kmap.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+
+/* Virtual memory areas.
+
+   A process's address space is described by a list of areas,
+   sorted by address: one per loaded ELF segment, one per
+   memory-mapped file, and the stack.
+
+   The struct page for a page of an area is created only when
+   the page is first touched, by vma_fault_page().  From then on
+   it records what the area cannot: which frame or swap slot
+   holds the page.  Until then the page costs nothing, so a large
+   BSS or a large mapping is as cheap to set up as a small one.
+
+   An area's list is changed only by its owner, or by a child
+   being forked while its parent waits.
+
+   The stack is the topmost area, an anonymous private one that
+   starts out one page long.  A fault in the pages below it, at
+   or above its stack pointer less 32 bytes (for PUSHA), moves
+   its START down, as far as its FLOOR, the lowest address its
+   stack limit allows.  The page below the floor is a guard page
+   that mmap() keeps free along with the rest of the stack's
+   region, and the stack never grows to within a page of another
+   area, so a stack overflow faults and kills the process rather
+   than running into other memory.
+
+   A stack that grows page by page, as deep recursion does,
+   would take a fault for each one, so a fault just below the
+   stack doubles the number of pages the growth takes, up to
+   STACK_PREFAULT_MAX, and pre-faults the extra ones.  Any other
+   stack fault starts over at one page. */
+
+/* A stack access may be this far below the stack pointer. */
+#define STACK_SLOP 32
+
+/* A fault at most this many pages below the stack counts as
+   "just below" it: a stack frame may skip a page. */
+#define STACK_STEADY_PAGES 2
+
+static struct vma *stack_vma (struct thread *);
+static void vma_free (struct vma *);
+static off_t page_file_bytes (const struct vma *, const void *upage);
+
+/* Creates an area of PAGE_CNT pages at START in the running
+   process, whose first FILE_BYTES bytes come from FILE starting
+   at offset OFS and whose other bytes are zeros.  FILE, if
+   non-null, is reopened for the area.  Returns the new area, or
+   a null pointer if it would overlap another area or leave user
+   memory, or if memory is short. */
+struct vma *
+vma_create (void *start, size_t page_cnt, struct file *file, off_t ofs,
+            off_t file_bytes, bool writable, enum vma_type type)
+{
+  struct thread *t = thread_current ();
+  struct list_elem *e;
+  struct vma *vma;
+
+  ASSERT (pg_ofs (start) == 0);
+  ASSERT (file != NULL || file_bytes == 0);
+
+  if (page_cnt == 0 || !is_user_vaddr (start)
+      || page_cnt > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) start)
+                    / PGSIZE
+      || vma_overlaps (t, start, page_cnt))
+    return NULL;
+
+  vma = malloc (sizeof *vma);
+  if (vma == NULL)
+    return NULL;
+  vma->file = NULL;
+  if (file != NULL)
+    {
+      vma->file = file_reopen (file);
+      if (vma->file == NULL)
+        {
+          free (vma);
+          return NULL;
+        }
+    }
+  vma->start = start;
+  vma->end = vma->start + page_cnt * PGSIZE;
+  vma->ofs = ofs;
+  vma->file_bytes = file_bytes;
+  vma->writable = writable;
+  vma->type = type;
+  vma->id = -1;
+  vma->floor = NULL;
+
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas); e = list_next (e))
+    if (list_entry (e, struct vma, elem)->start > vma->start)
+      break;
+  list_insert (e, &vma->elem);
+  return vma;
+}
+
+/* Creates the running process's stack, one page at the top of
+   user memory that may grow down as far as its stack limit.
+   Returns the stack, or a null pointer if memory is short. */
+struct vma *
+vma_create_stack (void)
+{
+  struct thread *t = thread_current ();
+  struct vma *stack = vma_create ((uint8_t *) PHYS_BASE - PGSIZE, 1, NULL,
+                                  0, 0, true, VMA_PRIVATE);
+
+  if (stack != NULL)
+    stack->floor = (uint8_t *) PHYS_BASE - t->stack_limit * PGSIZE;
+  t->stack_window = 1;
+  return stack;
+}
+
+/* Returns T's area that contains ADDR, or a null pointer if
+   there is none. */
+struct vma *
+vma_find (struct thread *t, const void *addr)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas); e = list_next (e))
+    {
+      struct vma *vma = list_entry (e, struct vma, elem);
+      if ((const uint8_t *) addr < vma->start)
+        break;
+      if ((const uint8_t *) addr < vma->end)
+        return vma;
+    }
+  return NULL;
+}
+
+/* Returns true if any of the PAGE_CNT pages starting at START
+   lies in one of T's areas. */
+bool
+vma_overlaps (struct thread *t, const void *start, size_t page_cnt)
+{
+  const uint8_t *end = (const uint8_t *) start + page_cnt * PGSIZE;
+  struct list_elem *e;
+
+  for (e = list_begin (&t->vmas); e != list_end (&t->vmas); e = list_next (e))
+    {
+      struct vma *vma = list_entry (e, struct vma, elem);
+      if (vma->start >= end)
+        break;
+      if ((const uint8_t *) start < vma->end)
+        return true;
+    }
+  return false;
+}
+
+/* Returns the running process's page at ADDR, creating it if
+   ADDR lies in one of its areas but the page has never been
+   touched, or a null pointer if ADDR lies in no area. */
+struct page *
+vma_fault_page (const void *addr)
+{
+  void *upage = pg_round_down (addr);
+  struct page *p = get_page (upage);
+  struct vma *vma;
+
+  if (p != NULL)
+    return p;
+  vma = vma_find (thread_current (), upage);
+  return vma != NULL ? init_page (upage, vma) : NULL;
+}
+
+/* Grows the running process's stack to take in ADDR, at which
+   it faulted with user stack pointer ESP, and pre-faults the
+   pages the growth takes beyond ADDR's page.  Returns false,
+   changing nothing, if ADDR is not below the stack, is too far
+   below ESP, or lies in the guard page or below the floor. */
+bool
+vma_grow_stack (const void *addr, const void *esp)
+{
+  struct thread *t = thread_current ();
+  struct vma *stack = stack_vma (t);
+  uint8_t *upage = pg_round_down (addr);
+  uint8_t *old_start, *start, *end;
+
+  if (stack == NULL || upage >= stack->start || upage < stack->floor
+      || (const uint8_t *) addr + STACK_SLOP < (const uint8_t *) esp
+      || vma_overlaps (t, upage - PGSIZE,
+                       (stack->start - upage) / PGSIZE + 1))
+    return false;
+
+  /* Take more pages if the stack is growing page by page. */
+  old_start = stack->start;
+  if ((size_t) (old_start - upage) / PGSIZE > STACK_STEADY_PAGES)
+    t->stack_window = 1;
+  else if (t->stack_window < STACK_PREFAULT_MAX)
+    t->stack_window *= 2;
+  start = upage;
+  if (t->stack_window - 1 <= (size_t) (upage - stack->floor) / PGSIZE)
+    start -= (t->stack_window - 1) * PGSIZE;
+  else
+    start = stack->floor;
+  if (vma_overlaps (t, start - PGSIZE, (upage - start) / PGSIZE + 1))
+    start = upage;
+  stack->start = start;
+
+  /* A large stack frame, one that jumps down past more than a
+     page, is likely to be used near ADDR as well. */
+  end = upage + PGSIZE;
+  if ((size_t) (old_start - end) / PGSIZE > STACK_PREFAULT_MAX)
+    end += STACK_PREFAULT_MAX * PGSIZE;
+  else
+    end = old_start;
+
+  page_prefault (stack, start, upage);
+  page_prefault (stack, upage + PGSIZE, end);
+  return true;
+}
+
+/* Returns the lowest address of the region that T keeps for its
+   stack: the floor of its stack, less the guard page below it,
+   or what the floor would be if T has no stack yet. */
+uint8_t *
+vma_stack_reserve (struct thread *t)
+{
+  struct vma *stack = stack_vma (t);
+  uint8_t *floor = (stack != NULL
+                    ? stack->floor
+                    : (uint8_t *) PHYS_BASE - t->stack_limit * PGSIZE);
+
+  return floor - PGSIZE;
+}
+
+/* Sets the stack limit of the processes that the running process
+   executes from now on to PAGE_CNT pages.  Its own stack keeps
+   the limit it was created with.  Returns false, changing
+   nothing, if PAGE_CNT is 0 or exceeds STACK_LIMIT_MAX. */
+bool
+vma_set_stack_limit (size_t page_cnt)
+{
+  if (page_cnt == 0 || page_cnt > STACK_LIMIT_MAX)
+    return false;
+  thread_current ()->stack_limit = page_cnt;
+  return true;
+}
+
+/* Gives the running process a copy of each of PARENT's private
+   areas.  Shared areas, that is, memory-mapped files, are not
+   inherited.  Returns false if memory runs out. */
+bool
+vma_fork (struct thread *parent)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&parent->vmas); e != list_end (&parent->vmas);
+       e = list_next (e))
+    {
+      struct vma *vma = list_entry (e, struct vma, elem);
+      struct vma *copy;
+
+      if (vma->type != VMA_PRIVATE)
+        continue;
+      copy = vma_create (vma->start, (vma->end - vma->start) / PGSIZE,
+                         vma->file, vma->ofs, vma->file_bytes,
+                         vma->writable, VMA_PRIVATE);
+      if (copy == NULL)
+        return false;
+      copy->floor = vma->floor;
+    }
+  return true;
+}
+
+/* Removes shared area VMA from the running process's address
+   space, writing its dirty pages back to its file, and frees it.
+   Must be called with frame_lock held, which is released while
+   writing. */
+void
+vma_unmap (struct vma *vma)
+{
+  struct thread *t = thread_current ();
+  struct pagedir_batch batch;
+  uint8_t *upage;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+  ASSERT (vma->type == VMA_SHARED);
+
+  pagedir_batch_begin (&batch);
+  for (upage = vma->start; upage < vma->end; upage += PGSIZE)
+    {
+      struct page *p = get_page (upage);
+
+      if (p == NULL)
+        continue;
+      page_wait_io (p);
+      if (p->frame_index != -1)
+        {
+          int frame = p->frame_index;
+
+          /* Pages of shared areas are never shared with other
+             processes, so once the page is out of the frame
+             table and unmapped, nobody else can touch the frame
+             and it can be written without frame_lock. */
+          remove_page_from_frames (p);
+          pagedir_clear_page (t->pagedir, upage);
+          if (pagedir_is_dirty (t->pagedir, upage))
+            {
+              void *kpage;
+
+              lock_release (&frame_lock);
+              kpage = frame_kmap (frame);
+              vma_write_page (vma, upage, kpage);
+              kunmap (kpage);
+              lock_acquire (&frame_lock);
+            }
+          deallocate_frame_index (frame);
+        }
+      spt_remove (&t->page_table, p);
+      free (p);
+    }
+  pagedir_batch_end (&batch);
+  vma_free (vma);
+}
+
+/* Frees all of the running process's areas.  Called at process
+   exit, after its pages have been destroyed. */
+void
+vma_destroy_all (void)
+{
+  struct thread *t = thread_current ();
+
+  while (!list_empty (&t->vmas))
+    vma_free (list_entry (list_front (&t->vmas), struct vma, elem));
+}
+
+/* Returns true if page UPAGE of VMA lies entirely within the
+   part of VMA backed by its file. */
+bool
+vma_page_in_file (const struct vma *vma, const void *upage)
+{
+  return page_file_bytes (vma, upage) == PGSIZE;
+}
+
+/* Returns true if page UPAGE of VMA has no bytes from VMA's
+   file, so that it starts out all zeros. */
+bool
+vma_page_is_zero (const struct vma *vma, const void *upage)
+{
+  return page_file_bytes (vma, upage) == 0;
+}
+
+/* Returns the offset in VMA's file of page UPAGE of VMA. */
+off_t
+vma_page_ofs (const struct vma *vma, const void *upage)
+{
+  return vma->ofs + ((const uint8_t *) upage - vma->start);
+}
+
+/* Reads the initial contents of page UPAGE of VMA into KPAGE.
+   Returns true if any of it came from VMA's file, false if the
+   page is all zeros. */
+bool
+vma_read_page (const struct vma *vma, const void *upage, void *kpage)
+{
+  off_t bytes = page_file_bytes (vma, upage);
+
+  if (bytes > 0
+      && file_read_at (vma->file, kpage, bytes,
+                       vma_page_ofs (vma, upage)) != bytes)
+    PANIC ("file read size mismatch");
+  memset ((uint8_t *) kpage + bytes, 0, PGSIZE - bytes);
+  return bytes > 0;
+}
+
+/* Writes page UPAGE of shared area VMA back from KPAGE to its
+   file.  The part of the page beyond the end of the file is not
+   written. */
+void
+vma_write_page (const struct vma *vma, const void *upage,
+                const void *kpage)
+{
+  off_t bytes = page_file_bytes (vma, upage);
+
+  ASSERT (vma->type == VMA_SHARED);
+  if (file_write_at (vma->file, kpage, bytes,
+                     vma_page_ofs (vma, upage)) != bytes)
+    PANIC ("mapped file write failed");
+}
+
+/* Returns T's stack, or a null pointer if it has none. */
+static struct vma *
+stack_vma (struct thread *t)
+{
+  struct vma *vma;
+
+  if (list_empty (&t->vmas))
+    return NULL;
+  vma = list_entry (list_back (&t->vmas), struct vma, elem);
+  return vma->floor != NULL ? vma : NULL;
+}
+
+/* Removes VMA from its owner's list, closes its file, and frees
+   it. */
+static void
+vma_free (struct vma *vma)
+{
+  list_remove (&vma->elem);
+  file_close (vma->file);
+  free (vma);
+}
+
+/* Returns the number of bytes of page UPAGE of VMA that come
+   from VMA's file. */
+static off_t
+page_file_bytes (const struct vma *vma, const void *upage)
+{
+  off_t left = vma->file_bytes - ((const uint8_t *) upage - vma->start);
+
+  if (left <= 0)
+    return 0;
+  return left < PGSIZE ? left : PGSIZE;
+}
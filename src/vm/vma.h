@@ -0,0 +1,68 @@
+#ifndef VM_VMA_H
+#define VM_VMA_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct file;
+struct thread;
+
+/* Kinds of virtual memory area. */
+enum vma_type
+  {
+    VMA_PRIVATE,                /* Written pages go to swap. */
+    VMA_SHARED                  /* Written pages go back to FILE. */
+  };
+
+/* Largest stack limit, in pages, that the stacklimit system call
+   accepts. */
+#define STACK_LIMIT_MAX (1 << 16)
+
+/* The most stack pages pre-faulted by one stack fault. */
+#define STACK_PREFAULT_MAX 32
+
+/* A virtual memory area: a run of pages in a process's address
+   space whose initial contents come from the same place.  Page
+   START + N * PGSIZE starts out as the bytes at offset OFS + N *
+   PGSIZE in FILE, as far as the first FILE_BYTES bytes of the
+   area reach, and as zeros beyond them.  An area with no file
+   is all zeros. */
+struct vma
+  {
+    struct list_elem elem;      /* Element in owner's list, by START. */
+    uint8_t *start;             /* First page. */
+    uint8_t *end;               /* One past the last page. */
+    struct file *file;          /* Backing file, or null. */
+    off_t ofs;                  /* Offset in FILE of START. */
+    off_t file_bytes;           /* Bytes of the area backed by FILE. */
+    bool writable;              /* May the pages be written? */
+    enum vma_type type;         /* What happens to written pages. */
+    int id;                     /* Mapping identifier, if shared. */
+    uint8_t *floor;             /* Lowest START of a stack, or null. */
+  };
+
+struct vma *vma_create (void *start, size_t page_cnt, struct file *,
+                        off_t ofs, off_t file_bytes, bool writable,
+                        enum vma_type);
+struct vma *vma_create_stack (void);
+struct vma *vma_find (struct thread *, const void *addr);
+bool vma_overlaps (struct thread *, const void *start, size_t page_cnt);
+struct page *vma_fault_page (const void *addr);
+bool vma_grow_stack (const void *addr, const void *esp);
+uint8_t *vma_stack_reserve (struct thread *);
+bool vma_set_stack_limit (size_t page_cnt);
+bool vma_fork (struct thread *parent);
+void vma_unmap (struct vma *);
+void vma_destroy_all (void);
+
+bool vma_page_in_file (const struct vma *, const void *upage);
+bool vma_page_is_zero (const struct vma *, const void *upage);
+off_t vma_page_ofs (const struct vma *, const void *upage);
+bool vma_read_page (const struct vma *, const void *upage, void *kpage);
+void vma_write_page (const struct vma *, const void *upage,
+                     const void *kpage);
+
+#endif /* vm/vma.h */
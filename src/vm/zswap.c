@@ -0,0 +1,403 @@
+#include "vm/zswap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <memstat.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "vm/swap.h"
+
+/* Compressed swap cache.
+
+   Pages written to swap are first offered to this cache, which
+   compresses them with a small LZ77 coder and keeps them in an
+   arena of kernel pages, so that a page that is swapped back in
+   soon costs no disk transfer either way.  Entries are keyed by
+   swap slot: a cached page still owns its slot, so slot
+   allocation, sharing after fork() and freeing work exactly as
+   before, and swap_free() drops the entry when the slot goes.
+
+   A page that does not shrink to ZSWAP_MAX_SIZE bytes is not
+   worth the arena space and goes straight to disk.  When the
+   arena has no room, the least recently compressed entries are
+   decompressed and written to their slots on disk ("spilled")
+   until it does.
+
+   Spills are done with zswap_lock held, so that no other thread
+   can see a slot whose contents are in neither place, or free
+   and reuse a slot while stale data is on its way to it. */
+
+/* The arena is allocated in chunks of this many bytes. */
+#define CHUNK_SIZE 64
+
+/* Largest compressed page worth caching. */
+#define ZSWAP_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* A cached page. */
+struct zswap_entry
+  {
+    struct hash_elem hash_elem; /* Element in cache. */
+    struct list_elem lru_elem;  /* Element in lru, oldest first. */
+    size_t slot;                /* Swap slot the page belongs to. */
+    size_t chunk;               /* First arena chunk. */
+    size_t size;                /* Compressed size in bytes. */
+  };
+
+static struct lock zswap_lock;  /* Protects everything below. */
+static struct hash cache;       /* Entries by slot. */
+static struct list lru;         /* Entries by age. */
+static uint8_t *arena;          /* Compressed pages, or null if off. */
+static size_t arena_pages;      /* Size of ARENA in pages. */
+static struct bitmap *chunk_map; /* Chunks of ARENA in use. */
+static size_t stored_bytes;     /* Compressed bytes in the cache. */
+
+/* Scratch space, one kernel page each. */
+static uint8_t *cbuf;           /* Compressor output. */
+static uint8_t *spill_page;     /* Page being spilled. */
+static uint16_t *lz_table;      /* Compressor hash table. */
+
+/* Statistics. */
+static unsigned long long store_cnt;    /* Pages cached. */
+static unsigned long long reject_cnt;   /* Pages that compressed poorly. */
+static unsigned long long hit_cnt;      /* Reads served from the cache. */
+static unsigned long long miss_cnt;     /* Reads that went to disk. */
+static unsigned long long spill_cnt;    /* Pages spilled to disk. */
+
+static struct zswap_entry *find_entry (size_t slot);
+static void remove_entry (struct zswap_entry *);
+static void spill (struct zswap_entry *);
+static size_t lz_compress (const uint8_t *src, uint8_t *dst, size_t max);
+static void lz_decompress (const uint8_t *src, size_t size, uint8_t *dst);
+static hash_hash_func entry_hash;
+static hash_less_func entry_less;
+
+/* Initializes the compressed swap cache with an arena of
+   PAGE_CNT kernel pages.  The cache stays off if PAGE_CNT is 0,
+   if there is no swap device, or if memory is short. */
+void
+zswap_init (size_t page_cnt)
+{
+  uint8_t *scratch;
+
+  lock_init (&zswap_lock);
+  hash_init (&cache, entry_hash, entry_less, NULL);
+  list_init (&lru);
+  if (page_cnt == 0 || block_get_role (BLOCK_SWAP) == NULL)
+    return;
+
+  arena = palloc_get_multiple (0, page_cnt);
+  scratch = palloc_get_multiple (0, 3);
+  chunk_map = bitmap_create (page_cnt * PGSIZE / CHUNK_SIZE);
+  if (arena == NULL || scratch == NULL || chunk_map == NULL)
+    {
+      printf ("zswap: out of memory, compressed swap cache disabled\n");
+      palloc_free_multiple (arena, page_cnt);
+      palloc_free_multiple (scratch, 3);
+      if (chunk_map != NULL)
+        bitmap_destroy (chunk_map);
+      arena = NULL;
+      return;
+    }
+  arena_pages = page_cnt;
+  cbuf = scratch;
+  spill_page = scratch + PGSIZE;
+  lz_table = (uint16_t *) (scratch + 2 * PGSIZE);
+  printf ("zswap: %zu-page compressed swap cache\n", page_cnt);
+}
+
+/* Offers PAGE, which is being written to swap slot SLOT, to the
+   cache.  Returns true if the cache took it, in which case it
+   need not be written to disk, false if it must be. */
+bool
+zswap_store (size_t slot, const void *page)
+{
+  struct zswap_entry *e;
+  size_t size, chunk_cnt, chunk;
+  bool stored = false;
+
+  if (arena == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  e = find_entry (slot);
+  if (e != NULL)
+    remove_entry (e);
+
+  size = lz_compress (page, cbuf, ZSWAP_MAX_SIZE);
+  if (size == 0)
+    {
+      reject_cnt++;
+      goto done;
+    }
+
+  chunk_cnt = DIV_ROUND_UP (size, CHUNK_SIZE);
+  while ((chunk = bitmap_scan_and_flip (chunk_map, 0, chunk_cnt, false))
+         == BITMAP_ERROR)
+    {
+      ASSERT (!list_empty (&lru));
+      spill (list_entry (list_front (&lru), struct zswap_entry, lru_elem));
+    }
+  e = malloc (sizeof *e);
+  if (e == NULL)
+    {
+      bitmap_set_multiple (chunk_map, chunk, chunk_cnt, false);
+      goto done;
+    }
+  e->slot = slot;
+  e->chunk = chunk;
+  e->size = size;
+  memcpy (arena + chunk * CHUNK_SIZE, cbuf, size);
+  hash_insert (&cache, &e->hash_elem);
+  list_push_back (&lru, &e->lru_elem);
+  stored_bytes += size;
+  store_cnt++;
+  stored = true;
+
+ done:
+  lock_release (&zswap_lock);
+  return stored;
+}
+
+/* Reads swap slot SLOT into PAGE from the cache.  Returns true
+   if successful, false if SLOT is not cached and must be read
+   from disk. */
+bool
+zswap_load (size_t slot, void *page)
+{
+  struct zswap_entry *e;
+
+  if (arena == NULL)
+    return false;
+
+  lock_acquire (&zswap_lock);
+  e = find_entry (slot);
+  if (e != NULL)
+    {
+      lz_decompress (arena + e->chunk * CHUNK_SIZE, e->size, page);
+      hit_cnt++;
+    }
+  else
+    miss_cnt++;
+  lock_release (&zswap_lock);
+  return e != NULL;
+}
+
+/* Discards the cached copy of swap slot SLOT, if any, because
+   the slot is being freed. */
+void
+zswap_drop (size_t slot)
+{
+  struct zswap_entry *e;
+
+  if (arena == NULL)
+    return;
+
+  lock_acquire (&zswap_lock);
+  e = find_entry (slot);
+  if (e != NULL)
+    remove_entry (e);
+  lock_release (&zswap_lock);
+}
+
+/* Fills in the compressed swap cache fields of STATS.  No lock
+   is taken, so this is safe to call from any context. */
+void
+zswap_get_stats (struct memstat *stats)
+{
+  stats->zswap_page_cnt = arena_pages;
+  stats->zswap_stored_cnt = hash_size (&cache);
+  stats->zswap_stored_bytes = stored_bytes;
+  stats->zswap_store_cnt = store_cnt;
+  stats->zswap_reject_cnt = reject_cnt;
+  stats->zswap_hit_cnt = hit_cnt;
+  stats->zswap_miss_cnt = miss_cnt;
+  stats->zswap_spill_cnt = spill_cnt;
+}
+
+/* Returns the entry for swap slot SLOT, or a null pointer if
+   SLOT is not cached. */
+static struct zswap_entry *
+find_entry (size_t slot)
+{
+  struct zswap_entry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&zswap_lock));
+
+  key.slot = slot;
+  e = hash_find (&cache, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct zswap_entry, hash_elem) : NULL;
+}
+
+/* Removes entry E from the cache and frees it. */
+static void
+remove_entry (struct zswap_entry *e)
+{
+  hash_delete (&cache, &e->hash_elem);
+  list_remove (&e->lru_elem);
+  bitmap_set_multiple (chunk_map, e->chunk,
+                       DIV_ROUND_UP (e->size, CHUNK_SIZE), false);
+  stored_bytes -= e->size;
+  free (e);
+}
+
+/* Writes the page cached in entry E to its swap slot on disk
+   and removes E from the cache. */
+static void
+spill (struct zswap_entry *e)
+{
+  lz_decompress (arena + e->chunk * CHUNK_SIZE, e->size, spill_page);
+  swap_write_disk (e->slot, spill_page);
+  spill_cnt++;
+  remove_entry (e);
+}
+
+/* Compressed format.  A compressed page is a sequence of
+   items, each introduced by a tag byte T:
+
+        - T < 0x80: a run of T + 1 literal bytes, which follow.
+
+        - T >= 0x80: a copy of (T & 0x7f) + MATCH_MIN bytes from
+          the output, starting OFS bytes back, where OFS is the
+          16-bit little-endian number that follows. */
+#define LITERAL_MAX 0x80
+#define MATCH_MIN 3
+#define MATCH_MAX (0x7f + MATCH_MIN)
+#define LZ_HASH_BITS 11
+
+/* Returns a hash of the 3 bytes at P. */
+static inline unsigned
+lz_hash (const uint8_t *p)
+{
+  uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends the CNT literal bytes at SRC to DST, which holds
+   *OP bytes and may hold at most MAX.  Returns false if they do
+   not fit. */
+static bool
+put_literals (const uint8_t *src, size_t cnt, uint8_t *dst, size_t *op,
+              size_t max)
+{
+  while (cnt > 0)
+    {
+      size_t run = cnt < LITERAL_MAX ? cnt : LITERAL_MAX;
+
+      if (*op + 1 + run > max)
+        return false;
+      dst[(*op)++] = run - 1;
+      memcpy (dst + *op, src, run);
+      *op += run;
+      src += run;
+      cnt -= run;
+    }
+  return true;
+}
+
+/* Compresses the page at SRC into DST and returns the
+   compressed size, or 0 if it would exceed MAX bytes.  Uses
+   lz_table, so zswap_lock must be held. */
+static size_t
+lz_compress (const uint8_t *src, uint8_t *dst, size_t max)
+{
+  size_t ip = 0;                /* Next input byte. */
+  size_t lit = 0;               /* First literal not yet output. */
+  size_t op = 0;                /* Output bytes. */
+
+  memset (lz_table, 0xff, (1 << LZ_HASH_BITS) * sizeof *lz_table);
+  while (ip + MATCH_MIN <= PGSIZE)
+    {
+      unsigned h = lz_hash (src + ip);
+      size_t ref = lz_table[h];
+
+      lz_table[h] = ip;
+      if (ref != 0xffff && !memcmp (src + ref, src + ip, MATCH_MIN))
+        {
+          size_t len = MATCH_MIN;
+
+          while (ip + len < PGSIZE && len < MATCH_MAX
+                 && src[ref + len] == src[ip + len])
+            len++;
+          if (!put_literals (src + lit, ip - lit, dst, &op, max)
+              || op + 3 > max)
+            return 0;
+          dst[op++] = 0x80 | (len - MATCH_MIN);
+          dst[op++] = (ip - ref) & 0xff;
+          dst[op++] = (ip - ref) >> 8;
+          ip += len;
+          lit = ip;
+        }
+      else
+        ip++;
+    }
+  if (!put_literals (src + lit, PGSIZE - lit, dst, &op, max))
+    return 0;
+  return op;
+}
+
+/* Decompresses the SIZE bytes at SRC, which must have been
+   produced by lz_compress(), into the page at DST. */
+static void
+lz_decompress (const uint8_t *src, size_t size, uint8_t *dst)
+{
+  size_t ip = 0, op = 0;
+
+  while (ip < size)
+    {
+      uint8_t tag = src[ip++];
+
+      if (tag < LITERAL_MAX)
+        {
+          size_t run = tag + 1;
+
+          ASSERT (op + run <= PGSIZE);
+          memcpy (dst + op, src + ip, run);
+          ip += run;
+          op += run;
+        }
+      else
+        {
+          size_t len = (tag & 0x7f) + MATCH_MIN;
+          size_t ofs = src[ip] | (src[ip + 1] << 8);
+
+          ASSERT (ofs > 0 && ofs <= op && op + len <= PGSIZE);
+          ip += 2;
+
+          /* The copy may overlap its own output, so it must go
+             byte by byte. */
+          for (; len > 0; len--, op++)
+            dst[op] = dst[op - ofs];
+        }
+    }
+  ASSERT (op == PGSIZE);
+}
+
+/* Returns a hash value for entry E. */
+static unsigned
+entry_hash (const struct hash_elem *e_, void *aux UNUSED)
+{
+  const struct zswap_entry *e = hash_entry (e_, struct zswap_entry,
+                                            hash_elem);
+  return hash_int (e->slot);
+}
+
+/* Returns true if entry A precedes entry B. */
+static bool
+entry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct zswap_entry *a = hash_entry (a_, struct zswap_entry,
+                                            hash_elem);
+  const struct zswap_entry *b = hash_entry (b_, struct zswap_entry,
+                                            hash_elem);
+  return a->slot < b->slot;
+}
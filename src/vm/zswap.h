@@ -0,0 +1,18 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Default size of the compressed swap cache, in kernel pages. */
+#define ZSWAP_DEFAULT_PAGES 64
+
+struct memstat;
+
+void zswap_init (size_t page_cnt);
+bool zswap_store (size_t slot, const void *page);
+bool zswap_load (size_t slot, void *page);
+void zswap_drop (size_t slot);
+void zswap_get_stats (struct memstat *);
+
+#endif /* vm/zswap.h */